@@ -14,6 +14,7 @@
 #include <string.h>
 
 #include "locking_table.h"
+#include "locking_table_private.h"
 
 /* clang-format off */
 
@@ -21,7 +22,7 @@
 /* Local Constant, Macro and Type Definitions                                 */
 /******************************************************************************/
 /* pystart - locks */
-static struct k_mutex adc;
+static LOCKING_SLOT(struct k_mutex) adc;
 /* pyend */
 
 /******************************************************************************/
@@ -35,19 +36,41 @@ static struct k_mutex adc;
  *
  *.........name...value...
  */
-#ifdef CONFIG_ATTR_STRING_NAME
-#define LOCK(n) STRINGIFY(n), &n
+#ifdef CONFIG_LOCKING_STRING_NAME
+#define LOCK_NAME(n) .name = STRINGIFY(n)
 #else
-#define LOCK(n) "", &n
+#define LOCK_NAME(n) .name = ""
 #endif
 
-#define y true
-#define n false
+#ifdef CONFIG_LOCKING_STATS
+#define LOCK(n) LOCK_NAME(n), .pData = &n.lock, .stats = &n.stats
+#else
+#define LOCK(n) LOCK_NAME(n), .pData = &n.lock
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+#define SEM_LOCK(n) LOCK(n), .holders = &n##_holders
+#else
+#define SEM_LOCK(n) LOCK(n)
+#endif
+
+/* x-instances, an array of lock objects under one ID */
+#ifdef CONFIG_LOCKING_STRIPED
+#define STRIPES(n) , .stripes = ARRAY_SIZE(n), .stride = sizeof(n[0])
+#else
+#define STRIPES(n)
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+#define STRIPED_LOCK(n) LOCK_NAME(n), .pData = &n[0].lock, .stats = &n[0].stats STRIPES(n)
+#else
+#define STRIPED_LOCK(n) LOCK_NAME(n), .pData = &n[0].lock STRIPES(n)
+#endif
 
 /* index....id.name.....................type...count.limit. */
 const struct locking_table_entry LOCKING_TABLE[LOCKING_TABLE_SIZE] = {
 	/* pystart - locking table */
-	[0  ] = { 0  , LOCK(adc)           , LOCKING_TYPE_MUTEX      , .count = 0  , .limit = 0   }
+	[0  ] = { .id = 0  , LOCK(adc)           , .type = LOCKING_TYPE_MUTEX      , .count = 0  , .limit = 0  , .instrument = LOCKING_INSTRUMENT_TRACE }
 	/* pyend */
 };
 
@@ -62,13 +85,30 @@ static const struct locking_table_entry * const LOCKING_MAP[] = {
 BUILD_ASSERT(ARRAY_SIZE(LOCKING_MAP) == (LOCKING_TABLE_MAX_ID + 1),
 	     "Invalid locking map");
 
+/**
+ * @brief RAM used by the lock objects (aligned slots include their padding)
+ *        and flash used by the table, map and names
+ */
+const struct locking_footprint LOCKING_FOOTPRINT = {
+	/* pystart - footprint */
+	.objects = sizeof(adc),
+	.aligned = 0,
+	.padding = 0,
+	.table = sizeof(LOCKING_TABLE),
+	.map = sizeof(LOCKING_MAP),
+#ifdef CONFIG_LOCKING_STRING_NAME
+	.names = 4,
+#endif
+	/* pyend */
+};
+
 /******************************************************************************/
 /* Global Function Definitions                                                */
 /******************************************************************************/
 void locking_table_initialise(void)
 {
 	/* pystart - init */
-	k_mutex_init(&adc);
+	k_mutex_init(&adc.lock);
 	/* pyend */
 }
 
@@ -81,7 +121,11 @@ void locking_table_reset(void)
 const struct locking_table_entry *const locking_map(locking_id_t id)
 {
 	if (id > LOCKING_TABLE_MAX_ID) {
+#ifdef CONFIG_LOCKING_DYNAMIC
+		return locking_dynamic_map(id);
+#else
 		return NULL;
+#endif
 	} else {
 		return LOCKING_MAP[id];
 	}
@@ -89,6 +133,23 @@ const struct locking_table_entry *const locking_map(locking_id_t id)
 
 locking_index_t locking_table_index(const struct locking_table_entry *const entry)
 {
+#ifdef CONFIG_LOCKING_DYNAMIC
+	if (!PART_OF_ARRAY(LOCKING_TABLE, entry)) {
+		return locking_dynamic_index(entry);
+	}
+#endif
 	__ASSERT(PART_OF_ARRAY(LOCKING_TABLE, entry), "Invalid entry");
 	return (entry - &LOCKING_TABLE[0]);
 }
+
+const struct locking_table_entry *locking_entry(locking_index_t index)
+{
+	if (index < LOCKING_TABLE_SIZE) {
+		return &LOCKING_TABLE[index];
+	}
+#ifdef CONFIG_LOCKING_DYNAMIC
+	return locking_dynamic_entry(index - LOCKING_TABLE_SIZE);
+#else
+	return NULL;
+#endif
+}
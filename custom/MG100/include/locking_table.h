@@ -38,6 +38,9 @@ extern "C" {
 /* pystart - locking constants */
 #define LOCKING_TABLE_SIZE              1
 #define LOCKING_TABLE_MAX_ID            0
+#define LOCKING_TABLE_CTF_EVENT_ID      0xe0
+#define LOCKING_TABLE_TYPES             (BIT(LOCKING_TYPE_MUTEX))
+#define LOCKING_TABLE_STRIPED           0
 /* pyend */
 
 #ifdef __cplusplus
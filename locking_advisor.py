@@ -0,0 +1,280 @@
+#
+# @file locking_advisor.py
+#
+# @brief Recommend lock type changes from a usage profile captured on a
+# device (the output of "locking profile", CONFIG_LOCKING_STATS).
+#
+# The profile is read from a console log, lines that are not profile lines are
+# ignored. Each lock is cross-referenced with its definition in the JSON file
+# and checked against a few rules: contention, starvation, recursion, ISR use,
+# semaphore units used and the cost of tracing locks that never contend. The
+# recommendations can also be written as a JSON Patch (RFC 6902) against the
+# JSON file.
+#
+# isr_takes, depth_max and the maximum wait and hold times need
+# CONFIG_LOCKING_INSTRUMENT, rules that need them are skipped without it.
+#
+# Copyright (c) 2022 Laird Connectivity
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+import argparse
+import json
+import os
+import re
+import sys
+
+from locking_generator import LoadLocks, STRIPED_TYPES, DEFAULT_INSTRUMENT
+
+SCRIPT_PATH = os.path.dirname(os.path.abspath(__file__))
+
+PROFILE_LINE = re.compile(r'profile (\{.*\})')
+LOCKS_PATH = "/components/contentDescriptors/deviceParams/x-device-locks"
+
+# Fewer takes than this are too few to judge a lock by
+MIN_TAKES = 100
+# Fraction of takes that had to wait for the lock to be worth changing
+CONTENDED = 0.1
+# A wait this many times the longest hold means waiters are overtaken
+STARVATION = 10
+# Holds up to this long are short enough to spread over stripes
+SHORT_HOLD_US = 100
+# Stripes proposed for a contended lock
+STRIPES = 4
+# Takes per second above which tracing an uncontended lock costs more than
+# it tells
+HOT_RATE = 1000
+# Fraction of takes that time out before it is reported
+TIMEOUTS = 0.01
+# Bytes of a holder record (CONFIG_LOCKING_HOLDERS) per semaphore unit
+HOLDER_SIZE = 12
+
+
+def ReadProfile(fname: str) -> tuple:
+    """ Profile lines of a console log, the last capture wins """
+    uptime = 0
+    profile = {}
+    with open(fname, 'r', errors='replace') as f:
+        for line in f:
+            m = PROFILE_LINE.search(line)
+            if m is None:
+                continue
+            d = json.loads(m.group(1))
+            if 'uptime_ms' in d:
+                uptime = d['uptime_ms']
+                profile = {}
+            else:
+                profile[d['id']] = d
+
+    if len(profile) == 0:
+        sys.exit(f"No profile lines in {fname} (capture \"locking profile\")")
+
+    return uptime, profile
+
+
+class advisor:
+    def __init__(self, parameterList: list, project: str, uptime: int,
+                 minTakes: int):
+        self.seconds = max(uptime, 1) / 1000
+        self.minTakes = minTakes
+        # id -> (index into the JSON lock list, lock)
+        self.locks = {}
+        for i, p in enumerate(parameterList):
+            if project is None or project in p['x-projects']:
+                self.locks[p['x-id']] = (i, p)
+
+        self.recommendations = []
+
+    def Recommend(self, p: dict, change: str, reason: str, gain: str,
+                  patch: list) -> None:
+        self.recommendations.append({"id": p['x-id'], "name": p['name'],
+                                     "type": p['schema']['type'],
+                                     "change": change, "reason": reason,
+                                     "gain": gain, "patch": patch})
+
+    def Set(self, index: int, path: str, value) -> dict:
+        """ add replaces a member that is already there """
+        return {"op": "add", "path": f"{LOCKS_PATH}/{index}/{path}",
+                "value": value}
+
+    def Rate(self, n: int) -> float:
+        return n / self.seconds
+
+    def Check(self, id: int, s: dict) -> None:
+        if id not in self.locks:
+            print(f"Lock {id} is not in the JSON file (or project), skipped",
+                  file=sys.stderr)
+            return
+
+        index, p = self.locks[id]
+        a = p['schema']
+        kind = a['type']
+        count = a.get('count', 0)
+        limit = a.get('limit', 0)
+        takes = s['takes']
+        contended = s['contended']
+        isr = s.get('isr_takes', 0)
+        depth = s.get('depth_max')
+        wait = s.get('wait_max_us')
+        hold = s.get('hold_max_us')
+
+        if s.get('level', 1) == 0:
+            return
+
+        if takes == 0:
+            self.Recommend(p, "remove, or x-instrument none if it is kept",
+                           "never taken in this profile", "", [])
+            return
+
+        if kind == "mutex" and isr > 0:
+            self.Recommend(p, "type pi_semaphore",
+                           f"taken {isr} times from an ISR, a mutex may only "
+                           "be taken by a thread",
+                           "no failed takes from ISRs, priority inheritance "
+                           "is kept for thread holders",
+                           [self.Set(index, "schema/type", "pi_semaphore")])
+            return
+
+        if takes < self.minTakes:
+            return
+
+        ratio = contended / takes
+        if kind == "semaphore":
+            self.CheckSemaphore(index, p, count, limit, ratio, isr, depth,
+                                contended)
+        elif kind in ["mutex", "ticket"]:
+            self.CheckExclusive(index, p, ratio, depth, wait, hold,
+                                contended)
+
+        if ratio == 0 and self.Rate(takes) >= HOT_RATE and \
+                p.get('x-instrument', DEFAULT_INSTRUMENT) == "trace":
+            self.Recommend(p, "x-instrument counters",
+                           f"{self.Rate(takes):.0f} takes/s and never "
+                           "contended, the trace events only show it is fine",
+                           f"{self.Rate(takes) * 3:.0f} trace events/s less",
+                           [self.Set(index, "x-instrument", "counters")])
+
+        if s['timeouts'] > takes * TIMEOUTS:
+            self.Recommend(p, "review callers",
+                           f"{s['timeouts']} takes timed out "
+                           f"({100 * s['timeouts'] / takes:.1f}%)",
+                           "", [])
+
+    def CheckSemaphore(self, index: int, p: dict, count: int, limit: int,
+                       ratio: float, isr: int, depth, contended: int) -> None:
+        # Semaphores that start with units taken are signals, not locks
+        if count != limit:
+            return
+
+        if depth is not None and 0 < depth < limit:
+            self.Recommend(p, f"limit {depth}",
+                           f"at most {depth} of {limit} units held at once",
+                           f"{(limit - depth) * HOLDER_SIZE} bytes of holder "
+                           "records less (CONFIG_LOCKING_HOLDERS)",
+                           [self.Set(index, "schema/limit", depth),
+                            self.Set(index, "schema/count", depth)])
+        elif limit == 1 and ratio >= CONTENDED:
+            # A binary semaphore used as a mutex, but it may be given by
+            # another thread or taken in an ISR, which a mutex does not allow
+            self.Recommend(p, "type pi_semaphore",
+                           f"binary semaphore, {100 * ratio:.0f}% of takes "
+                           "contended and the holder does not inherit the "
+                           "waiters' priority" +
+                           (" (taken from ISRs)" if isr > 0 else ""),
+                           f"priority inversion bounded for "
+                           f"{self.Rate(contended):.0f} contended takes/s",
+                           [self.Set(index, "schema/type", "pi_semaphore"),
+                            self.Set(index, "schema/count", 0),
+                            self.Set(index, "schema/limit", 1)])
+
+    def CheckExclusive(self, index: int, p: dict, ratio: float, depth,
+                       wait, hold, contended: int) -> None:
+        kind = p['schema']['type']
+        if ratio < CONTENDED:
+            return
+
+        reason = f"{100 * ratio:.0f}% of takes contended"
+        if wait is not None and hold is not None:
+            reason += f", longest wait {wait} us hold {hold} us"
+
+        if kind == "mutex" and wait is not None and hold is not None and \
+                wait > STARVATION * max(hold, 1) and \
+                (depth is None or depth <= 1):
+            self.Recommend(p, "type ticket",
+                           reason + ", waiters are overtaken",
+                           f"waits bounded by the queue ahead, not {wait} us",
+                           [self.Set(index, "schema/type", "ticket")])
+        elif hold is not None and hold > SHORT_HOLD_US:
+            self.Recommend(p, "split",
+                           reason + ", long holds",
+                           "contention divided between the new locks, "
+                           "guard independent data with separate locks", [])
+        elif kind in STRIPED_TYPES:
+            # Stripes are rounded up to a power of two by the generator
+            stripes = 1 << (max(p.get('x-instances', 0), 1) - 1).bit_length()
+            more = max(stripes * 2, STRIPES)
+            self.Recommend(p, f"stripe with x-instances {more}" +
+                           (" (take with locking_take_key)"
+                            if stripes == 1 else ""),
+                           reason + ", short holds",
+                           f"about {self.Rate(contended) * stripes / more:.0f}"
+                           f" contended takes/s instead of "
+                           f"{self.Rate(contended):.0f} if the keys spread",
+                           [self.Set(index, "x-instances", more)])
+
+    def Patch(self) -> list:
+        patch = []
+        for r in self.recommendations:
+            patch += r['patch']
+        return patch
+
+
+def PrintRecommendations(recommendations: list) -> None:
+    if len(recommendations) == 0:
+        print("No recommendations")
+        return
+
+    for r in recommendations:
+        print(f"[{r['id']:03}] {r['name']} ({r['type']}): {r['change']}")
+        print(f"      because {r['reason']}")
+        if r['gain']:
+            print(f"      expected {r['gain']}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Recommend lock type changes from a device lock profile")
+    parser.add_argument("profile",
+                        help="console log holding the output of "
+                        "\"locking profile\"")
+    parser.add_argument("--json", dest="file_name",
+                        default=os.path.join(SCRIPT_PATH, "lockings.json"),
+                        help="lock definitions the profile was taken with")
+    parser.add_argument("--project",
+                        help="project the device was built for, when lock "
+                        "IDs differ between projects")
+    parser.add_argument("--min-takes", type=int, default=MIN_TAKES,
+                        help="ignore locks taken fewer times than this")
+    parser.add_argument("--patch",
+                        help="write the recommended changes as a JSON Patch "
+                        "against the JSON file")
+    parser.add_argument("--report",
+                        help="write the recommendations as JSON instead of "
+                        "printing them")
+    args = parser.parse_args()
+
+    uptime, profile = ReadProfile(args.profile)
+    a = advisor(LoadLocks(args.file_name), args.project, uptime,
+                args.min_takes)
+    for id in sorted(profile):
+        a.Check(id, profile[id])
+
+    if args.report:
+        with open(args.report, 'w') as f:
+            json.dump(a.recommendations, f, indent=2)
+    else:
+        PrintRecommendations(a.recommendations)
+
+    if args.patch:
+        with open(args.patch, 'w') as f:
+            json.dump(a.Patch(), f, indent=2)
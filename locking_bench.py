@@ -0,0 +1,162 @@
+#
+# @file locking_bench.py
+#
+# @brief Measure how boot time, footprint and lookup cost scale with the size
+# of the lock table.
+#
+# Builds the application once per table size, with dense and sparse IDs, using
+# a synthetic table from locking_generator.py (CONFIG_LOCKING_GENERATE_TABLE)
+# and CONFIG_LOCKING_BENCH. The footprint is read from the symbols of each
+# zephyr.elf. With --run each build is also run (e.g. on qemu) and the times
+# are taken from the "bench" line logged at boot. The results are printed as a
+# markdown table, --summary appends it to a file (e.g. $GITHUB_STEP_SUMMARY).
+#
+# Copyright (c) 2022 Laird Connectivity
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+from locking_generator import SynthesizeLocks
+
+SIZES = [1, 16, 256, 4096]
+DENSITIES = ["dense", "sparse"]
+BENCH_LINE = re.compile(r'bench (\{.*\})')
+# Names of the synthetic locks, see SynthesizeLocks
+LOCK_SYMBOL = re.compile(r'lock_\d+$')
+RUN_TIMEOUT = 120
+
+COLUMNS = [("locks", "locks"), ("ids", "IDs"), ("max_id", "max ID"),
+           ("init_ns", "init (ns)"), ("map_ns", "map (ns)"),
+           ("get_id_ns", "get_id (ns)"), ("objects", "objects (B)"),
+           ("table", "table (B)"), ("map", "map (B)"), ("names", "names (B)")]
+
+
+def Build(args, size: int, density: str) -> str:
+    """ Build for one synthetic table, returns the build folder """
+    build = os.path.join(args.build_dir, f"{size}-{density}")
+    generate = f"--synthesize {size}"
+    if density == "sparse":
+        generate += " --sparse"
+
+    cmd = ["west", "build", "-p", "auto", "-b", args.board, "-d", build,
+           args.app, "--",
+           "-DCONFIG_LOCKING_GENERATE_TABLE=y",
+           f"-DCONFIG_LOCKING_GENERATE_PROJECT={args.project}",
+           f"-DCONFIG_LOCKING_GENERATE_ARGS={generate}",
+           "-DCONFIG_LOCKING_BENCH=y"]
+    print(' '.join(cmd), file=sys.stderr)
+    subprocess.run(cmd, check=True, stdout=sys.stderr)
+
+    return build
+
+
+def Footprint(nm: str, elf: str) -> dict:
+    """ Sizes of the table, map and lock objects from the symbol table """
+    out = subprocess.run([nm, "-S", elf], check=True, capture_output=True,
+                         text=True).stdout
+    result = {"table": 0, "map": 0, "objects": 0}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        size = int(fields[1], 16)
+        name = fields[3]
+        if name == "LOCKING_TABLE":
+            result["table"] = size
+        elif name == "LOCKING_MAP":
+            result["map"] = size
+        elif LOCK_SYMBOL.match(name):
+            result["objects"] += size
+    return result
+
+
+def Run(build: str, timeout: int) -> dict:
+    """ Run the build until it logs the bench line """
+    cmd = ["west", "build", "-d", build, "-t", "run"]
+    p = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT, text=True)
+    end = time.monotonic() + timeout
+    result = None
+    try:
+        for line in p.stdout:
+            m = BENCH_LINE.search(line)
+            if m is not None:
+                result = json.loads(m.group(1))
+                break
+            if time.monotonic() > end:
+                break
+    finally:
+        p.terminate()
+        p.wait()
+
+    if result is None:
+        sys.exit(f"No bench line from {build} (is logging enabled?)")
+
+    return result
+
+
+def Markdown(results: list) -> str:
+    lines = ["| " + " | ".join(title for key, title in COLUMNS) + " |",
+             "|" + "---:|" * len(COLUMNS)]
+    for r in results:
+        lines.append("| " + " | ".join(str(r.get(key, "-"))
+                                       for key, title in COLUMNS) + " |")
+    return "\n".join(lines) + "\n"
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Measure lock table scaling with synthetic tables")
+    parser.add_argument("app", help="application to build (must enable "
+                        "CONFIG_LOCKING and logging)")
+    parser.add_argument("-b", "--board", required=True,
+                        help="board to build for, e.g. qemu_cortex_m3")
+    parser.add_argument("--project", default="MG100",
+                        help="project name given to the synthetic locks")
+    parser.add_argument("--sizes", default=','.join(map(str, SIZES)),
+                        help="comma separated table sizes")
+    parser.add_argument("--build-dir", default="build_locking_bench",
+                        help="folder holding one build per table")
+    parser.add_argument("--nm", default="nm",
+                        help="nm of the toolchain, e.g. arm-zephyr-eabi-nm")
+    parser.add_argument("--run", action="store_true",
+                        help="run each build (west build -t run) to measure "
+                        "the times")
+    parser.add_argument("--timeout", type=int, default=RUN_TIMEOUT,
+                        help="seconds to wait for the bench line")
+    parser.add_argument("--summary",
+                        help="append the markdown table to this file")
+    parser.add_argument("--json", dest="json_file",
+                        help="write the results as JSON")
+    args = parser.parse_args()
+
+    results = []
+    for size in [int(s) for s in args.sizes.split(',')]:
+        for density in DENSITIES:
+            build = Build(args, size, density)
+            # Same seed as the build, so the same IDs
+            ids = [p['x-id'] for p in SynthesizeLocks(
+                size, [args.project], 0, density == "sparse")]
+            r = {"locks": size, "ids": density, "max_id": max(ids)}
+            r.update(Footprint(args.nm,
+                               os.path.join(build, "zephyr", "zephyr.elf")))
+            if args.run:
+                # The device also reports the names, built into the image
+                r.update(Run(build, args.timeout))
+            results.append(r)
+
+    table = Markdown(results)
+    print(table)
+    if args.summary:
+        with open(args.summary, 'a') as f:
+            f.write("## Lock table scaling\n\n" + table)
+    if args.json_file:
+        with open(args.json_file, 'w') as f:
+            json.dump(results, f, indent=2)
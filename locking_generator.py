@@ -3,6 +3,10 @@
 #
 # @brief Generate C code from JSON document.
 #
+# Run with --all to refresh the checked-in custom/<project> tables, or let the
+# build run it (CONFIG_LOCKING_GENERATE_TABLE) to generate into the build
+# folder.
+#
 # Copyright (c) 2018-2022 Laird Connectivity
 #
 # SPDX-License-Identifier: Apache-2.0
@@ -11,9 +15,10 @@ import json
 import jsonref
 import collections
 import os
-import inflection
 import sys
 import math
+import random
+import argparse
 
 JSON_INDENT = '  '
 
@@ -24,10 +29,74 @@ DEFINE_WIDTH = 20
 TYPE_WIDTH = 24
 COUNT_LIMIT_WIDTH = 12
 
-BASE_FILE_PATH = "./custom/%PROJ%"
-HEADER_FILE_PATH = "%BASE%/include/"
-SOURCE_FILE_PATH = "%BASE%/source/"
+SCRIPT_PATH = os.path.dirname(os.path.abspath(__file__))
+OUTPUT_PATH = os.path.join(SCRIPT_PATH, "custom")
+TEMPLATE_PATH = os.path.join(SCRIPT_PATH, "universal", "template")
+HEADER_FILE_PATH = "include"
+SOURCE_FILE_PATH = "source"
 TABLE_FILE_NAME = "locking_table"
+TSDL_FILE_PATH = "tsdl"
+TSDL_FILE_NAME = "locking_metadata"
+
+# First CTF event ID, must match CONFIG_LOCKING_TRACING_EVENT_ID
+CTF_EVENT_ID = 0xE0
+
+# CTF events in ID order: (name, fields), locking_trace_analyzer.py decodes
+# the same layout
+CTF_EVENTS = [
+    ("locking_take_enter", ["enum locking_id_t id", "locking_index_t index",
+                            "locking_thread_t thread"]),
+    ("locking_take_exit", ["enum locking_id_t id", "locking_index_t index",
+                           "locking_thread_t thread",
+                           "locking_result_t result"]),
+    ("locking_give", ["enum locking_id_t id", "locking_index_t index",
+                      "locking_thread_t thread",
+                      "locking_result_t result"]),
+    ("locking_handoff", ["enum locking_id_t id", "locking_index_t index",
+                         "locking_thread_t thread", "locking_thread_t to"]),
+]
+
+# JSON type -> (C object, table type, initialisation)
+LOCK_TYPES = {
+    "mutex": ("struct k_mutex", "MUTEX",
+              "k_mutex_init(&{name}.lock)"),
+    "semaphore": ("struct k_sem", "SEMAPHORE",
+                  "k_sem_init(&{name}.lock, {count}, {limit})"),
+    "ticket": ("struct locking_ticket", "TICKET",
+               "locking_ticket_init(&{name}.lock, {bypass})"),
+    "combining": ("struct locking_combining", "COMBINING",
+                  "locking_combining_init(&{name}.lock)"),
+    "pool": ("struct locking_pool", "POOL",
+             "locking_pool_init(&{name}.lock, {name}_map, "
+             "LOCKING_POOL_OWNER({name}), {limit})"),
+    "barrier": ("struct locking_barrier", "BARRIER",
+                "locking_barrier_init(&{name}.lock, {limit})"),
+    "latch": ("struct locking_latch", "LATCH",
+              "locking_latch_init(&{name}.lock, {count})"),
+    "rate": ("struct locking_rate", "RATE",
+             "locking_rate_init(&{name}.lock, {rate}, {limit})"),
+    "pi_semaphore": ("struct locking_pi_sem", "PI_SEMAPHORE",
+                     "locking_pi_sem_init(&{name}.lock)"),
+}
+
+# Lock types that can be striped with x-instances
+STRIPED_TYPES = ["mutex", "ticket"]
+MAX_INSTANCES = 1024
+
+# IDs of a --sparse synthetic table are spread over this many times its size
+SPARSE_RANGE = 8
+
+# Highest x-rate-per-sec of a rate lock
+MAX_RATE = 1000000
+
+# x-instrument levels, each includes the ones before it. The level is the
+# most a lock can be instrumented at runtime (CONFIG_LOCKING_INSTRUMENT).
+INSTRUMENT_LEVELS = ["none", "counters", "timing", "trace"]
+DEFAULT_INSTRUMENT = "trace"
+
+# Place every lock in its own cache line (--align), x-align does it per lock
+ALIGN_ALL = False
+CACHE_LINE_SIZE = 64
 
 def ToInt(b) -> str:
     return math.trunc(b)
@@ -67,11 +136,88 @@ def PrintDuplicate(lst):
         if count > 1:
             print(item)
 
+def LoadLocks(fname: str) -> list:
+    """ Load the lock list (with references resolved) from the JSON file """
+    with open(fname, 'r') as f:
+        data = jsonref.load(f)
+        return data['components']['contentDescriptors']['deviceParams']['x-device-locks']
+
+def SynthesizeLocks(size: int, projects: list, seed: int,
+                    sparse: bool = False) -> list:
+    """
+    Make a lock list of the given size for stress testing, roughly a quarter
+    are semaphores with a few units (all free), the rest are mutexes. Sparse
+    IDs are spread over SPARSE_RANGE times as many IDs (the map grows with
+    the largest ID).
+    """
+    rng = random.Random(seed)
+    if sparse:
+        ids = sorted(rng.sample(range(min(size * SPARSE_RANGE, 0xFFFF)), size))
+    else:
+        ids = list(range(size))
+    parameterList = []
+    for i in range(size):
+        if rng.random() < 0.25:
+            units = rng.randint(1, 4)
+            schema = {"type": "semaphore", "count": units, "limit": units}
+        else:
+            schema = {"type": "mutex"}
+        parameterList.append({
+            "name": f"lock_{i:04d}",
+            "summary": "Synthetic stress test lock",
+            "x-id": ids[i],
+            "x-projects": projects,
+            "schema": schema
+        })
+    return parameterList
+
+def GetProjects(parameterList: list) -> list:
+    """ All projects named by any lock, in a stable order """
+    projects = {}
+    for p in parameterList:
+        for project in p['x-projects']:
+            projects[project] = True
+    return sorted(projects)
+
+def IncrementVersion(fname: str) -> None:
+    """
+    Increment version of the form x.y.z and write it back to the file.
+    """
+    with open(fname, 'r') as f:
+        data = json.load(f)
+        major, minor, build = data['info']['version'].split('.')
+        build = int(build) + 1
+        new_version = f'{major}.{minor}.{build}'
+        data['info']['version'] = new_version
+        print(new_version)
+
+    with open(fname, 'w') as f:
+        json.dump(data, f, indent=JSON_INDENT)
+
+def WriteIfChanged(name: str, lst: list) -> None:
+    """
+    Only write the file when its contents change, so that its timestamp
+    (and therefore the build) is left alone when nothing changed
+    """
+    contents = ''.join(lst)
+    try:
+        with open(name, 'r') as fin:
+            if fin.read() == contents:
+                print("Unchanged " + name)
+                return
+    except FileNotFoundError:
+        pass
+
+    os.makedirs(os.path.dirname(name), exist_ok=True)
+    print("Writing " + name)
+    with open(name, 'w') as fout:
+        fout.write(contents)
+
 class locks:
-    def __init__(self, project: str, fname: str):
+    def __init__(self, project: str, parameterList: list):
 
         # The following items are loaded from the configuration file
-        self.parameterList = 0
+        self.parameterList = parameterList
         self.projectLocksCount = 0
         self.apiTotalLocks = 0
         self.MaxNameLength = 0
@@ -82,103 +228,95 @@ class locks:
         self.apiId = []
         self.count = []
         self.limit = []
+        self.bypass = []
         self.name = []
         self.apiName = []
         self.type = []
-
-        self.IncrementVersion(fname)
-        self.LoadConfig(fname)
-
-    def IncrementVersion(self, fname: str) -> None:
-        """
-        Increment version of the form x.y.z and write it back to the file.
-        """
-        with open(fname, 'r') as f:
-            data = json.load(f)
-            api_version = data['info']['version']
-            major, minor, build = data['info']['version'].split('.')
-            build = int(build) + 1
-            new_version = f'{major}.{minor}.{build}'
-            data['info']['version'] = new_version
-            print(new_version)
-
-        with open(fname, 'w') as f:
-            json.dump(data, f, indent=JSON_INDENT)
-
-    def LoadConfig(self, fname: str) -> None:
-        with open(fname, 'r') as f:
-            data = jsonref.load(f)
-            self.parameterList = data['components']['contentDescriptors']['deviceParams']['x-device-locks']
-            self.apiTotalLocks = len(self.parameterList)
-            file_name = HEADER_FILE_PATH + TABLE_FILE_NAME
-            self.inputHeaderFileName = file_name
-            self.outputHeaderFileName = file_name + ""
-            file_name = SOURCE_FILE_PATH + TABLE_FILE_NAME
-            self.inputSourceFileName = file_name
-            self.outputSourceFileName = file_name + ""
-
-            # Extract the properties for each parameter
-            for p in self.parameterList:
-                self.apiName.append(p['name'])
-                self.apiId.append(p['x-id'])
-                if self.project in p['x-projects']:
-                    # required fields
-                    self.name.append(p['name'])
-                    self.id.append(p['x-id'])
-                    # required schema fields
-                    a = p['schema']
-                    self.type.append(a['type'])
-                    # optional schema fields have a default value
-                    self.count.append(ToInt(GetNumberField(a, 'count')))
-                    self.limit.append(ToInt(GetNumberField(a, 'limit')))
-
-            self.projectLocksCount = len(self.name)
-            print(f"API Total Locks {self.apiTotalLocks}")
-            print(
-                f"Project {self.project} Locks {self.projectLocksCount}")
-            print(f"Project {self.project} Maximum ID {max(self.id)}")
-            self.PrintAvailableIds()
-            pass
+        self.align = []
+        self.instances = []
+        self.instrument = []
+        self.rate = []
+
+        # id -> index into the project lists
+        self.indexOfId = {}
+
+        self.LoadConfig()
+
+    def LoadConfig(self) -> None:
+        self.apiTotalLocks = len(self.parameterList)
+
+        # Extract the properties for each parameter
+        for p in self.parameterList:
+            self.apiName.append(p['name'])
+            self.apiId.append(p['x-id'])
+            if self.project in p['x-projects']:
+                # required fields
+                self.indexOfId.setdefault(p['x-id'], len(self.id))
+                self.name.append(p['name'])
+                self.id.append(p['x-id'])
+                self.align.append(ALIGN_ALL or GetBoolField(p, 'x-align'))
+                self.instances.append(ToInt(GetNumberField(p, 'x-instances')))
+                self.instrument.append(
+                    GetStringField(p, 'x-instrument') or DEFAULT_INSTRUMENT)
+                self.rate.append(ToInt(GetNumberField(p, 'x-rate-per-sec')))
+                # required schema fields
+                a = p['schema']
+                self.type.append(a['type'])
+                # optional schema fields have a default value
+                self.count.append(ToInt(GetNumberField(a, 'count')))
+                self.limit.append(ToInt(GetNumberField(a, 'limit')))
+                self.bypass.append(ToInt(GetNumberField(a, 'bypass')))
+
+        self.projectLocksCount = len(self.name)
+        print(f"API Total Locks {self.apiTotalLocks}")
+        print(
+            f"Project {self.project} Locks {self.projectLocksCount}")
+        print(f"Project {self.project} Maximum ID {max(self.id)}")
+        self.PrintAvailableIds()
 
     def GetType(self, index: int) -> str:
         kind = self.type[index]
         s = "LOCKING_TYPE_"
-        if kind == "mutex":
-            s += "MUTEX"
-        elif kind == "semaphore":
-            s += "SEMAPHORE"
+        if kind in LOCK_TYPES:
+            s += LOCK_TYPES[kind][1]
         else:
             s += "UNKNOWN"
 
         return s
 
+    def GetStripes(self, index: int) -> int:
+        """
+        Number of lock objects, x-instances is rounded up to a power of two
+        so that a key maps to a stripe with a mask
+        """
+        n = max(self.instances[index], 1)
+        return 1 << (n - 1).bit_length()
+
     def GetLockMacro(self, index: int) -> str:
         """Get the c-macro for the lock"""
         name = self.name[index]
-        s = "LOCK(" + name + ")"
+        if self.GetStripes(index) > 1:
+            s = "STRIPED_LOCK(" + name + ")"
+        elif self.type[index] == "semaphore":
+            s = "SEM_LOCK(" + name + ")"
+        else:
+            s = "LOCK(" + name + ")"
         return s.ljust(NAME_MACRO_WIDTH)
 
+    def GetInstrument(self, index: int) -> str:
+        return "LOCKING_INSTRUMENT_" + self.instrument[index].upper()
+
     def CreateCountLimitString(self, index: int) -> str:
         """
         Create the count/limit portion of the lock table entry for semaphores
         """
-        kind = self.type[index]
-        i_min = self.count[index]
-        i_max = self.limit[index]
-        i_min = int(i_min)
-        i_max = int(i_max)
+        i_min = int(self.count[index])
+        i_max = int(self.limit[index])
         s_min = f".count = " + str(i_min)
         s_max = f".limit = " + str(i_max)
 
         return s_min.ljust(COUNT_LIMIT_WIDTH) + ", " + s_max.ljust(COUNT_LIMIT_WIDTH)
 
-    def GetIndex(self, name: str) -> int:
-        """ Get the index for a key/name """
-        for i in range(self.projectLocksCount):
-            if self.name[i] == name:
-                return i
-        return -1
-
     def CreateAttrTable(self) -> str:
         """
         Create the lock (property) table from the dictionary of lists
@@ -187,9 +325,10 @@ class locks:
         lockTable = []
         for i in range(self.projectLocksCount):
             result = f"\t[{i:<3}] = " \
-                + "{ " + f"{self.id[i]:<3}, " \
-                + f"{self.GetLockMacro(i)}, {self.GetType(i).ljust(TYPE_WIDTH)}, " \
-                + f"{self.CreateCountLimitString(i)}" \
+                + "{ " + f".id = {self.id[i]:<3}, " \
+                + f"{self.GetLockMacro(i)}, .type = {self.GetType(i).ljust(TYPE_WIDTH)}, " \
+                + f"{self.CreateCountLimitString(i)}, " \
+                + f".instrument = {self.GetInstrument(i)}" \
                 + " }," \
                 + "\n"
             lockTable.append(result)
@@ -205,13 +344,19 @@ class locks:
         """
         lockTable = []
         for i in range(self.projectLocksCount):
-            kind = self.type[i]
             name = self.name[i]
-            if kind == "mutex":
-                result = f"\tk_mutex_init(&{name});\n"
-            elif kind == "semaphore":
-                result = f"\tk_sem_init(&{name}, {int(self.count[i])}, {int(self.limit[i])});\n"
-            lockTable.append(result)
+            if self.GetStripes(i) > 1:
+                name += "[i]"
+            init = LOCK_TYPES[self.type[i]][2].format(
+                name=name, count=int(self.count[i]),
+                limit=int(self.limit[i]), bypass=int(self.bypass[i]),
+                rate=int(self.rate[i]))
+            if self.GetStripes(i) > 1:
+                lockTable.append(
+                    f"\tfor (size_t i = 0; i < ARRAY_SIZE({self.name[i]}); i++) {{\n"
+                    + f"\t\t{init};\n\t}}\n")
+            else:
+                lockTable.append(f"\t{init};\n")
 
         string = ''.join(lockTable)
         return string
@@ -225,8 +370,19 @@ class locks:
             kind = self.type[i]
             name = self.name[i]
             if kind == "semaphore":
-                result = f"\tk_sem_reset(&{name});\n"
+                result = f"\tk_sem_reset(&{name}.lock);\n" \
+                    + f"\tLOCKING_HOLDERS_RESET({name});\n"
                 lockTable.append(result)
+            elif kind == "pool":
+                lockTable.append(f"\tlocking_pool_reset(&{name}.lock);\n")
+            elif kind == "barrier":
+                lockTable.append(f"\tlocking_barrier_reset(&{name}.lock);\n")
+            elif kind == "latch":
+                lockTable.append(f"\tlocking_latch_reset(&{name}.lock);\n")
+            elif kind == "rate":
+                lockTable.append(f"\tlocking_rate_reset(&{name}.lock);\n")
+            elif kind == "pi_semaphore":
+                lockTable.append(f"\tlocking_pi_sem_reset(&{name}.lock);\n")
 
         string = ''.join(lockTable)
         return string
@@ -237,17 +393,17 @@ class locks:
         """
         if len(set(self.id)) != len(self.id):
             print("Duplicate lock ID in Project")
-            PrintDuplicate(self.apiName)
+            PrintDuplicate(self.id)
             return False
 
         if len(set(self.apiId)) != len(self.apiId):
             print("Duplicate lock ID in API")
-            PrintDuplicate(self.apiName)
+            PrintDuplicate(self.apiId)
             return False
 
         if len(set(self.name)) != len(self.name):
             print("Duplicate lock Name")
-            PrintDuplicate(self.apiName)
+            PrintDuplicate(self.name)
             return False
 
         if len(set(self.apiName)) != len(self.apiName):
@@ -263,7 +419,36 @@ class locks:
         """
         for i in range(self.projectLocksCount):
             kind = self.type[i]
-            if kind == "semaphore":
+            if kind not in LOCK_TYPES:
+                print(f"Unknown lock type: {self.name[i]} with type {kind}")
+                return False
+            elif kind != "ticket" and self.bypass[i] != 0:
+                print(f"Bypass is only supported by ticket locks:" +
+                      f" {self.name[i]} with type {kind}")
+                return False
+            elif self.instances[i] > 1 and kind not in STRIPED_TYPES:
+                print(f"x-instances is only supported by" +
+                      f" {', '.join(STRIPED_TYPES)} locks:" +
+                      f" {self.name[i]} with type {kind}")
+                return False
+            elif self.instances[i] < 0 or self.instances[i] > MAX_INSTANCES:
+                print(f"x-instances must be 0 to {MAX_INSTANCES}:" +
+                      f" {self.name[i]} with x-instances {self.instances[i]}")
+                return False
+            elif self.instrument[i] not in INSTRUMENT_LEVELS:
+                print(f"x-instrument must be one of" +
+                      f" {', '.join(INSTRUMENT_LEVELS)}:" +
+                      f" {self.name[i]} with x-instrument {self.instrument[i]}")
+                return False
+            elif kind != "rate" and self.rate[i] != 0:
+                print(f"x-rate-per-sec is only supported by rate locks:" +
+                      f" {self.name[i]} with type {kind}")
+                return False
+            elif self.bypass[i] < 0 or self.bypass[i] > 255:
+                print(f"Ticket bypass must be 0 to 255:" +
+                      f" {self.name[i]} with bypass {self.bypass[i]}")
+                return False
+            elif kind == "semaphore":
                 i_count = self.count[i]
                 i_limit = self.limit[i]
 
@@ -275,22 +460,84 @@ class locks:
                     print(f"Semaphore count must be less than or equal to limit:" +
                           f" {self.name[i]} with count {i_count} and limit {i_limit}")
                     return False
+            elif kind == "pool":
+                # Every slot starts free, the limit is the number of slots
+                if self.limit[i] < 1 or self.limit[i] > 255:
+                    print(f"Pool limit must be 1 to 255:" +
+                          f" {self.name[i]} with limit {self.limit[i]}")
+                    return False
+                elif self.count[i] != 0:
+                    print(f"Pool count is not supported (all slots start free):" +
+                          f" {self.name[i]} with count {self.count[i]}")
+                    return False
+            elif kind == "barrier":
+                # The limit is the number of parties of each phase
+                if self.limit[i] < 1 or self.limit[i] > 255:
+                    print(f"Barrier limit must be 1 to 255:" +
+                          f" {self.name[i]} with limit {self.limit[i]}")
+                    return False
+                elif self.count[i] != 0:
+                    print(f"Barrier count is not supported:" +
+                          f" {self.name[i]} with count {self.count[i]}")
+                    return False
+            elif kind == "rate":
+                # The limit is the burst, the bucket starts full
+                if self.rate[i] < 1 or self.rate[i] > MAX_RATE:
+                    print(f"x-rate-per-sec must be 1 to {MAX_RATE}:" +
+                          f" {self.name[i]} with x-rate-per-sec {self.rate[i]}")
+                    return False
+                elif self.limit[i] < 1 or self.limit[i] > 255:
+                    print(f"Rate limit (burst) must be 1 to 255:" +
+                          f" {self.name[i]} with limit {self.limit[i]}")
+                    return False
+                elif self.count[i] != 0:
+                    print(f"Rate count is not supported (the bucket starts full):" +
+                          f" {self.name[i]} with count {self.count[i]}")
+                    return False
+            elif kind == "pi_semaphore":
+                # Binary, it starts free
+                if self.count[i] != 0 or self.limit[i] > 1:
+                    print(f"pi_semaphore is binary and starts free, count must be 0" +
+                          f" and limit 0 or 1: {self.name[i]} with count" +
+                          f" {self.count[i]} and limit {self.limit[i]}")
+                    return False
+            elif kind == "latch":
+                # The count is the number of count downs that open it
+                if self.count[i] < 1 or self.count[i] > 255:
+                    print(f"Latch count must be 1 to 255:" +
+                          f" {self.name[i]} with count {self.count[i]}")
+                    return False
+                elif self.limit[i] != 0:
+                    print(f"Latch limit is not supported:" +
+                          f" {self.name[i]} with limit {self.limit[i]}")
+                    return False
 
         return True
 
-    def UpdateFiles(self) -> None:
+    def UpdateFiles(self, template_path: str, output_path: str) -> bool:
         """
         Update the lock c/h files.
         """
         if self.CheckForDuplicates() == False:
-            return
+            return False
         if self.CheckForValidOptions() == False:
-            return
+            return False
 
+        base = os.path.join(output_path, self.project)
         self.CreateSourceFile(
-            self.CreateInsertionList(SOURCE_FILE_PATH + TABLE_FILE_NAME + ".c"))
+            os.path.join(base, SOURCE_FILE_PATH, TABLE_FILE_NAME + ".c"),
+            self.CreateInsertionList(
+                os.path.join(template_path, TABLE_FILE_NAME + ".c")))
         self._CreateLockHeaderFile(
-            self.CreateInsertionList(HEADER_FILE_PATH + TABLE_FILE_NAME + ".h"))
+            os.path.join(base, HEADER_FILE_PATH, TABLE_FILE_NAME + ".h"),
+            self.CreateInsertionList(
+                os.path.join(template_path, TABLE_FILE_NAME + ".h")))
+        self.CreateMetadataFile(
+            os.path.join(base, TSDL_FILE_PATH, TSDL_FILE_NAME),
+            self.CreateInsertionList(
+                os.path.join(template_path, TSDL_FILE_NAME + ".tsdl")))
+        self.PrintMemoryReport()
+        return True
 
     def CreateInsertionList(self, name: str) -> list:
         """
@@ -321,62 +568,134 @@ class locks:
         for i in range(self.projectLocksCount):
             name = self.name[i]
             # string is required in test tool, c requires char type
-            if self.type[i] == "mutex":
-                kind = "struct k_mutex"
-            elif self.type[i] == "semaphore":
-                kind = "struct k_sem"
+            kind = LOCK_TYPES[self.type[i]][0]
+
+            # Hot locks get a cache line to themselves, cold ones stay packed
+            if self.align[i]:
+                slot = "LOCKING_SLOT_ALIGNED"
+            else:
+                slot = "LOCKING_SLOT"
+
+            # Striped locks are an array, each stripe has its own statistics
+            # (and cache line when aligned)
+            stripes = self.GetStripes(i)
+            if stripes > 1:
+                if stripes != self.instances[i]:
+                    print(f"Lock {name} x-instances {self.instances[i]}"
+                          f" rounded up to {stripes}")
+                array = f"[{stripes}]"
+            else:
+                array = ""
 
             # Use tabs because we use tabs with Zephyr/clang-format.
-            result = f"static {kind} {name};" + "\n"
+            result = f"static {slot}({kind}) {name}{array};" + "\n"
             struct.append(result)
 
+            # One holder record per unit (CONFIG_LOCKING_HOLDERS)
+            if self.type[i] == "semaphore":
+                struct.append(
+                    f"LOCKING_HOLDERS_DEFINE({name}, {int(self.limit[i])});\n")
+            # Free slot bitmap (and owners with CONFIG_LOCKING_POOL_CHECKS)
+            elif self.type[i] == "pool":
+                struct.append(
+                    f"LOCKING_POOL_DEFINE({name}, {int(self.limit[i])});\n")
+
         string = ''.join(struct)
         return string
 
+    def CreateFootprint(self) -> str:
+        """
+        Create the RAM footprint of the lock objects and the flash used by
+        the table, map and names, the compiler supplies the sizes so that the
+        figures match the configuration being built
+        """
+        objects = []
+        aligned = []
+        padding = []
+        for i in range(self.projectLocksCount):
+            name = self.name[i]
+            objects.append(f"sizeof({name})")
+            if self.align[i]:
+                aligned.append(f"sizeof({name})")
+                if self.GetStripes(i) > 1:
+                    padding.append(
+                        f"(sizeof({name}) - ARRAY_SIZE({name})"
+                        f" * LOCKING_SLOT_PAYLOAD({name}[0]))")
+                else:
+                    padding.append(
+                        f"(sizeof({name}) - LOCKING_SLOT_PAYLOAD({name}))")
+
+        def Sum(lst: list) -> str:
+            if len(lst) == 0:
+                return "0"
+            return "\n\t\t + ".join(lst)
+
+        # Names are only stored with CONFIG_LOCKING_STRING_NAME
+        names = sum(len(name) + 1 for name in self.name)
+
+        return f"\t.objects = {Sum(objects)},\n" \
+            + f"\t.aligned = {Sum(aligned)},\n" \
+            + f"\t.padding = {Sum(padding)},\n" \
+            + "\t.table = sizeof(LOCKING_TABLE),\n" \
+            + "\t.map = sizeof(LOCKING_MAP),\n" \
+            + "#ifdef CONFIG_LOCKING_STRING_NAME\n" \
+            + f"\t.names = {names},\n" \
+            + "#endif\n"
+
+    def PrintMemoryReport(self) -> None:
+        """
+        Report the worst case RAM spent on cache line alignment, the exact
+        figure is available at runtime through LOCKING_FOOTPRINT
+        """
+        aligned = self.align.count(True)
+        print(f"Project {self.project} Aligned Locks {aligned} of "
+              f"{self.projectLocksCount} (cache line {CACHE_LINE_SIZE})")
+        if aligned > 0:
+            print(f"Project {self.project} Alignment Cost <= "
+                  f"{aligned * (CACHE_LINE_SIZE - 1)} bytes padding")
+
     def CreateMap(self) -> str:
         """
         Create map of ids to table entries
         Invalid entries are NULL
         """
-        s = ""
+        lst = []
         for i in range(max(self.id) + 1):
-            if i in self.id:
-                idx = self.id.index(i)
-                s += f"\t[{i:<3}] = &LOCKING_TABLE[{idx:<3}],\n"
+            idx = self.indexOfId.get(i)
+            if idx is not None:
+                lst.append(f"\t[{i:<3}] = &LOCKING_TABLE[{idx:<3}],\n")
 
+        s = ''.join(lst)
         s = s[:s.rfind(',')] + '\n'
 
         return s
 
     def PrintAvailableIds(self):
-        available = []
-        for i in range(self.apiTotalLocks):
-            if i not in self.apiId:
-                available.append(i)
+        used = set(self.apiId)
+        available = [i for i in range(self.apiTotalLocks) if i not in used]
 
         print(f"Available API IDs\n {available}")
 
-    def CreateSourceFile(self, lst: list) -> None:
+    def CreateSourceFile(self, name: str, lst: list) -> None:
         """Create the settings/lock/properties *.c file"""
-        name = SOURCE_FILE_PATH + TABLE_FILE_NAME + ".c"
-        print("Writing " + name)
-        with open(name, 'w') as fout:
-            for index, line in enumerate(lst):
-                next_line = index + 1
-                if "pystart - " in line:
-                    if "locking table" in line:
-                        lst.insert(next_line, self.CreateAttrTable())
-                    elif "locking map" in line:
-                        lst.insert(next_line, self.CreateMap())
-                    elif "init" in line:
-                        lst.insert(next_line, self.CreateInit())
-                    elif "reset" in line:
-                        lst.insert(next_line, self.CreateReset())
-                    elif "locks" in line:
-                        lst.insert(
-                            next_line, self.CreateStruct(False))
-
-            fout.writelines(lst)
+        out = []
+        for line in lst:
+            out.append(line)
+            if "pystart - " in line:
+                if "locking table" in line:
+                    out.append(self.CreateAttrTable())
+                elif "locking map" in line:
+                    out.append(self.CreateMap())
+                elif "footprint" in line:
+                    out.append(self.CreateFootprint())
+                elif "init" in line:
+                    out.append(self.CreateInit())
+                elif "reset" in line:
+                    out.append(self.CreateReset())
+                elif "locks" in line:
+                    out.append(self.CreateStruct(False))
+
+        WriteIfChanged(name, out)
 
     def CreateIds(self) -> str:
         """Create lock IDs for header file"""
@@ -397,6 +716,22 @@ class locks:
         defs.append(self.JustifyDefine(
             "TABLE_MAX_ID", "", max(self.id)))
 
+        # Lets the module check that the CTF metadata matches its Kconfig
+        defs.append(self.JustifyDefine(
+            "TABLE_CTF_EVENT_ID", "", hex(CTF_EVENT_ID)))
+
+        # Lets the module check that every type used is enabled
+        types = sorted(set(self.type), key=list(LOCK_TYPES).index)
+        defs.append(self.JustifyDefine(
+            "TABLE_TYPES", "", "(" + " | ".join(
+                f"BIT(LOCKING_TYPE_{LOCK_TYPES[t][1]})" for t in types) + ")"))
+
+        # Lets the module check that striped locks are enabled
+        striped = any(self.GetStripes(i) > 1
+                      for i in range(self.projectLocksCount))
+        defs.append(self.JustifyDefine(
+            "TABLE_STRIPED", "", int(striped)))
+
         return ''.join(defs)
 
     def JustifyDefine(self, key: str, suffix: str, value: int) -> str:
@@ -407,60 +742,119 @@ class locks:
             name = key
         return "#define LOCKING_" + name.ljust(width) + f" {str(value)}\n"
 
-    def _CreateLockHeaderFile(self, lst: list) -> None:
+    def _CreateLockHeaderFile(self, name: str, lst: list) -> None:
         """Create the locks header file"""
-        name = HEADER_FILE_PATH + TABLE_FILE_NAME + ".h"
-        print("Writing " + name)
-        with open(name, 'w') as fout:
-            for index, line in enumerate(lst):
-                next_line = index + 1
-                if "pystart - " in line:
-                    if "locking ids" in line:
-                        lst.insert(next_line, self.CreateIds())
-                    elif "locking constants" in line:
-                        lst.insert(next_line, self.CreateConstants())
+        out = []
+        for line in lst:
+            out.append(line)
+            if "pystart - " in line:
+                if "locking ids" in line:
+                    out.append(self.CreateIds())
+                elif "locking constants" in line:
+                    out.append(self.CreateConstants())
+
+        WriteIfChanged(name, out)
+
+    def CreateCtfIds(self) -> str:
+        """Map lock IDs to names for trace viewers"""
+        ids = []
+        for name, id in zip(self.name, self.id):
+            ids.append(f"\t\"{name}\" = {id},\n")
+        return ''.join(ids)
 
-            fout.writelines(lst)
+    def CreateCtfEvents(self) -> str:
+        """Declare the events emitted by locking_tracing.c"""
+        events = []
+        for i, (name, fields) in enumerate(CTF_EVENTS):
+            events.append("event {\n"
+                          + f"\tname = {name};\n"
+                          + f"\tid = {hex(CTF_EVENT_ID + i)};\n"
+                          + "\tfields := struct {\n"
+                          + ''.join(f"\t\t{f};\n" for f in fields)
+                          + "\t};\n"
+                          + "};\n\n")
+        string = ''.join(events)
+        return string[:-1]
+
+    def CreateMetadataFile(self, name: str, lst: list) -> None:
+        """Create the CTF metadata fragment"""
+        out = []
+        for line in lst:
+            out.append(line)
+            if "pystart - " in line:
+                if "ctf ids" in line:
+                    out.append(self.CreateCtfIds())
+                elif "ctf events" in line:
+                    out.append(self.CreateCtfEvents())
+
+        WriteIfChanged(name, out)
 
 
 if __name__ == "__main__":
-    file_name = "./lockings.json"
-    if ((len(sys.argv)-1)) == 1:
-        project = sys.argv[1]
-    elif ((len(sys.argv)-1)) == 2:
-        project = sys.argv[1]
-        file_name = sys.argv[2]
+    parser = argparse.ArgumentParser(
+        description="Generate the locking table for one or more projects")
+    parser.add_argument("project", nargs="*",
+                        help="project(s) to generate (default MG100)")
+    parser.add_argument("--json", dest="file_name",
+                        default=os.path.join(SCRIPT_PATH, "lockings.json"),
+                        help="lock definitions")
+    parser.add_argument("--all", action="store_true",
+                        help="generate every project named in the JSON file")
+    parser.add_argument("--output", default=OUTPUT_PATH,
+                        help="output folder, files are written to "
+                        "<output>/<project>/{include,source,tsdl}")
+    parser.add_argument("--template", default=TEMPLATE_PATH,
+                        help="folder holding the locking_table.c/h and "
+                        "locking_metadata.tsdl templates")
+    parser.add_argument("--bump-version", action="store_true",
+                        help="increment the version in the JSON file")
+    parser.add_argument("--align", action="store_true",
+                        help="place every lock in its own cache line")
+    parser.add_argument("--cache-line", type=int, default=CACHE_LINE_SIZE,
+                        help="cache line size used for the memory report")
+    parser.add_argument("--ctf-event-id", type=lambda x: int(x, 0),
+                        default=CTF_EVENT_ID,
+                        help="first CTF event ID (CONFIG_LOCKING_TRACING_EVENT_ID)")
+    parser.add_argument("--synthesize", type=int, metavar="N",
+                        help="ignore the JSON file and generate N synthetic "
+                        "locks (for CONFIG_LOCKING_STRESS)")
+    parser.add_argument("--sparse", action="store_true",
+                        help="spread the IDs of --synthesize over "
+                        f"{SPARSE_RANGE} times as many IDs")
+    parser.add_argument("--seed", type=int, default=0,
+                        help="seed for --synthesize, the same seed gives "
+                        "the same table")
+    args = parser.parse_args()
+
+    ALIGN_ALL = args.align
+    CACHE_LINE_SIZE = args.cache_line
+    CTF_EVENT_ID = args.ctf_event_id
+
+    # Backwards compatible form: locking_generator.py <project> <file>
+    projects = args.project
+    if len(projects) == 2 and projects[1].endswith(".json"):
+        args.file_name = projects.pop()
+
+    if args.bump_version:
+        IncrementVersion(args.file_name)
+
+    if args.synthesize is not None:
+        if args.synthesize < 1 or args.synthesize > 0xFFFE:
+            sys.exit("Synthetic table size must be 1 to 65534")
+        if len(projects) == 0:
+            projects = ["MG100"]
+        parameterList = SynthesizeLocks(args.synthesize, projects, args.seed,
+                                        args.sparse)
     else:
-        project = "MG100"
-
-    # Add project name to paths
-    BASE_FILE_PATH = BASE_FILE_PATH.replace("%PROJ%", project)
-    HEADER_FILE_PATH = HEADER_FILE_PATH.replace("%BASE%", BASE_FILE_PATH)
-    SOURCE_FILE_PATH = SOURCE_FILE_PATH.replace("%BASE%", BASE_FILE_PATH)
-
-    # Ensure path directories exists, else create them
-    if (not os.path.isdir(BASE_FILE_PATH)):
-        os.mkdir(BASE_FILE_PATH)
-        print("Created base folder for project " +
-              project + " at " + BASE_FILE_PATH)
-    if (not os.path.isdir(HEADER_FILE_PATH)):
-        os.mkdir(HEADER_FILE_PATH)
-        print("Created header folder for project " +
-              project + " at " + HEADER_FILE_PATH)
-    if (not os.path.isdir(SOURCE_FILE_PATH)):
-        os.mkdir(SOURCE_FILE_PATH)
-        print("Created source folder for project " +
-              project + " at " + SOURCE_FILE_PATH)
-
-    # Ensure .h and .c file exist
-    if (not os.path.exists(HEADER_FILE_PATH + TABLE_FILE_NAME + ".h")):
-        raise Exception("Missing header file for project " + project +
-                        " at " + HEADER_FILE_PATH + TABLE_FILE_NAME + ".h")
-    if (not os.path.exists(SOURCE_FILE_PATH + TABLE_FILE_NAME + ".c")):
-        raise Exception("Missing source file for project " + project +
-                        " at " + SOURCE_FILE_PATH + TABLE_FILE_NAME + ".c")
+        parameterList = LoadLocks(args.file_name)
 
-    # Parse locks
-    a = locks(project, file_name)
+    if args.all:
+        projects = GetProjects(parameterList)
+    elif len(projects) == 0:
+        projects = ["MG100"]
 
-    a.UpdateFiles()
+    # Parse locks
+    for project in projects:
+        a = locks(project, parameterList)
+        if not a.UpdateFiles(args.template, args.output):
+            sys.exit(f"Failed to generate locking table for {project}")
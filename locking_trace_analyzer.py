@@ -0,0 +1,429 @@
+#
+# @file locking_trace_analyzer.py
+#
+# @brief Turn lock trace events (CONFIG_LOCKING_TRACING) into contention
+# reports and a Chrome/Perfetto timeline.
+#
+# Reads either a raw stream holding only the locking events (the CTF stream
+# file with the other tracing groups disabled), or a full CTF trace folder
+# through the babeltrace2 python bindings (--ctf). Events are processed as
+# they are read, memory use depends on the number of locks and threads, not on
+# the length of the capture.
+#
+# Copyright (c) 2022 Laird Connectivity
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+import argparse
+import collections
+import json
+import os
+import struct
+import sys
+
+from locking_generator import LoadLocks, CTF_EVENT_ID, CTF_EVENTS
+
+SCRIPT_PATH = os.path.dirname(os.path.abspath(__file__))
+
+# Raw event layout, see locking_tracing.c and CTF_EVENTS in the generator
+HEADER = struct.Struct("<IB")
+TAKE_ENTER = 0
+TAKE_EXIT = 1
+GIVE = 2
+HANDOFF = 3
+FIELDS = {
+    TAKE_ENTER: struct.Struct("<HHI"),
+    TAKE_EXIT: struct.Struct("<HHIi"),
+    GIVE: struct.Struct("<HHIi"),
+    HANDOFF: struct.Struct("<HHII"),
+}
+EVENT_NAMES = [name for name, fields in CTF_EVENTS]
+
+# Kernel events that name threads (--ctf only)
+THREAD_NAME_EVENTS = ["thread_switched_in", "thread_switched_out",
+                      "thread_create", "thread_name_set", "thread_info"]
+
+READ_SIZE = 64 * 1024
+CHAIN_DEPTH = 4
+TOP = 10
+
+# to is the new owner of a handoff
+Event = collections.namedtuple(
+    "Event", ["kind", "time", "id", "index", "thread", "result", "to"],
+    defaults=[0])
+
+
+def ReadRaw(fname: str, first_id: int):
+    """ Decode a stream of locking events a block at a time """
+    buf = b''
+    offset = 0
+    with open(fname, 'rb') as f:
+        while True:
+            block = f.read(READ_SIZE)
+            if not block:
+                break
+            buf = buf[offset:] + block
+            offset = 0
+            while len(buf) - offset >= HEADER.size:
+                time, event_id = HEADER.unpack_from(buf, offset)
+                kind = event_id - first_id
+                if kind not in FIELDS:
+                    sys.exit(f"Unknown event ID {hex(event_id)} at byte "
+                             f"{f.tell() - len(buf) + offset}, raw streams must "
+                             "only hold locking events (use --ctf otherwise)")
+                size = HEADER.size + FIELDS[kind].size
+                if len(buf) - offset < size:
+                    break
+                fields = FIELDS[kind].unpack_from(buf, offset + HEADER.size)
+                if kind == HANDOFF:
+                    yield Event(kind, time, fields[0], fields[1], fields[2],
+                                0, fields[3])
+                else:
+                    result = fields[3] if len(fields) > 3 else 0
+                    yield Event(kind, time, fields[0], fields[1], fields[2],
+                                result)
+                offset += size
+
+    if len(buf) != offset:
+        print(f"Ignoring {len(buf) - offset} bytes of truncated event",
+              file=sys.stderr)
+
+
+def ReadCtf(path: str, names: dict):
+    """ Decode a CTF trace folder (Zephyr metadata + locking_metadata) """
+    try:
+        import bt2
+    except ImportError:
+        sys.exit("--ctf needs the babeltrace2 python bindings (bt2)")
+
+    for msg in bt2.TraceCollectionMessageIterator(path):
+        if type(msg) is not bt2._EventMessageConst:
+            continue
+        event = msg.event
+        payload = event.payload_field
+        if event.name in EVENT_NAMES:
+            kind = EVENT_NAMES.index(event.name)
+            result = int(payload['result']) \
+                if kind in [TAKE_EXIT, GIVE] else 0
+            to = int(payload['to']) if kind == HANDOFF else 0
+            yield Event(kind, msg.default_clock_snapshot.value,
+                        int(payload['id']), int(payload['index']),
+                        int(payload['thread']), result, to)
+        elif event.name in THREAD_NAME_EVENTS and 'name' in payload:
+            names[int(payload['thread_id'])] = str(payload['name'])
+
+
+class histogram:
+    """ Power of two buckets, so the size does not grow with the capture """
+
+    def __init__(self):
+        self.buckets = collections.Counter()
+        self.count = 0
+        self.total = 0
+        self.min = None
+        self.max = 0
+
+    def Add(self, value: int) -> None:
+        self.buckets[value.bit_length()] += 1
+        self.count += 1
+        self.total += value
+        self.min = value if self.min is None else min(self.min, value)
+        self.max = max(self.max, value)
+
+    def Percentile(self, p: float) -> int:
+        """ Upper bound of the bucket holding the percentile """
+        target = self.count * p
+        seen = 0
+        for bits in sorted(self.buckets):
+            seen += self.buckets[bits]
+            if seen >= target:
+                return min((1 << bits) - 1, self.max)
+        return self.max
+
+    def Summary(self, unit) -> dict:
+        if self.count == 0:
+            return {"count": 0}
+        return {"count": self.count,
+                "min": unit(self.min),
+                "mean": unit(self.total / self.count),
+                "p50": unit(self.Percentile(0.5)),
+                "p90": unit(self.Percentile(0.9)),
+                "p99": unit(self.Percentile(0.99)),
+                "max": unit(self.max),
+                "total": unit(self.total)}
+
+
+class timeline:
+    """ Chrome trace event JSON written as the events complete, the format
+    only has microsecond timestamps so unit must convert to them """
+
+    def __init__(self, fname: str, unit):
+        self.f = open(fname, 'w')
+        self.f.write('{"traceEvents": [\n')
+        self.first = True
+        self.unit = unit
+        self.named = set()
+
+    def Write(self, d: dict) -> None:
+        if not self.first:
+            self.f.write(",\n")
+        self.first = False
+        self.f.write(json.dumps(d))
+
+    def Span(self, name: str, category: str, thread: int, start: int,
+             end: int, args: dict) -> None:
+        self.Write({"name": name, "cat": category, "ph": "X", "pid": 1,
+                    "tid": thread, "ts": self.unit(start),
+                    "dur": self.unit(end - start), "args": args})
+
+    def ThreadName(self, thread: int, name: str) -> None:
+        if thread not in self.named:
+            self.named.add(thread)
+            self.Write({"name": "thread_name", "ph": "M", "pid": 1,
+                        "tid": thread, "args": {"name": name}})
+
+    def Close(self) -> None:
+        self.f.write("\n]}\n")
+        self.f.close()
+
+
+class analyzer:
+    def __init__(self, lockNames: dict, threadNames: dict, unit, trace):
+        self.lockNames = lockNames
+        self.threadNames = threadNames
+        self.unit = unit
+        self.trace = trace
+
+        self.wait = collections.defaultdict(histogram)
+        self.hold = collections.defaultdict(histogram)
+        self.failed = collections.Counter()
+        # (waiter, lock, holder) -> [count, blocked time]
+        self.pairs = collections.defaultdict(lambda: [0, 0])
+        # (waiter, lock, holder, lock, holder ...) -> [count, blocked time]
+        self.chains = collections.defaultdict(lambda: [0, 0])
+
+        # Open state only, holds are (thread, taken, owned since)
+        self.holders = collections.defaultdict(list)
+        self.waiting = {}
+
+        self.last = None
+        self.wraps = 0
+        self.events = 0
+
+    def LockName(self, id: int) -> str:
+        return self.lockNames.get(id, f"id {id}")
+
+    def ThreadName(self, thread: int) -> str:
+        return self.threadNames.get(thread, hex(thread))
+
+    def Time(self, time: int) -> int:
+        """ Undo the wrap of the 32-bit cycle counter """
+        if self.last is not None and time < self.last:
+            self.wraps += 1
+        self.last = time
+        return time + (self.wraps << 32)
+
+    def Blockers(self, id: int, thread: int) -> list:
+        return [h[0] for h in self.holders[id] if h[0] != thread]
+
+    def Chain(self, id: int, thread: int) -> list:
+        """
+        Who the waiter is blocked behind, and (transitively) what they are
+        blocked behind
+        """
+        chain = [thread]
+        while len(chain) < (CHAIN_DEPTH * 2) + 1:
+            blockers = self.Blockers(id, chain[-1])
+            if len(blockers) == 0 or blockers[0] in chain[0::2]:
+                break
+            chain += [id, blockers[0]]
+            if blockers[0] not in self.waiting:
+                break
+            id = self.waiting[blockers[0]][0]
+        return chain
+
+    def Process(self, e: Event) -> None:
+        time = self.Time(e.time)
+        self.events += 1
+        if self.trace is not None and e.thread in self.threadNames:
+            self.trace.ThreadName(e.thread, self.threadNames[e.thread])
+
+        if e.kind == TAKE_ENTER:
+            self.waiting[e.thread] = (e.id, time, self.Chain(e.id, e.thread))
+
+        elif e.kind == TAKE_EXIT:
+            id, start, chain = self.waiting.pop(e.thread, (e.id, time, []))
+            waited = time - start
+            self.wait[e.id].Add(waited)
+            if waited > 0 and len(chain) > 1:
+                self.pairs[(e.thread, e.id, chain[2])][0] += 1
+                self.pairs[(e.thread, e.id, chain[2])][1] += waited
+                self.chains[tuple(chain)][0] += 1
+                self.chains[tuple(chain)][1] += waited
+            if self.trace is not None and waited > 0:
+                self.trace.Span(f"wait {self.LockName(e.id)}", "wait",
+                                e.thread, start, time,
+                                {"result": e.result,
+                                 "blocked by": [self.ThreadName(t)
+                                                for t in chain[2::2]]})
+            if e.result == 0:
+                self.holders[e.id].append((e.thread, time, time))
+            else:
+                self.failed[e.id] += 1
+
+        elif e.kind == GIVE and e.result == 0:
+            held = self.holders[e.id]
+            # Newest hold of the giver, else the oldest (given on behalf)
+            mine = [i for i, h in enumerate(held) if h[0] == e.thread]
+            if len(mine) > 0:
+                thread, start, since = held.pop(mine[-1])
+            elif len(held) > 0:
+                thread, start, since = held.pop(0)
+            else:
+                return
+            self.hold[e.id].Add(time - start)
+            if self.trace is not None:
+                self.trace.Span(f"hold {self.LockName(e.id)}", "hold",
+                                thread, since, time, {})
+
+        elif e.kind == HANDOFF:
+            # The lock was never free, the hold carries on under the new
+            # owner (one span per owner on the timeline)
+            held = self.holders[e.id]
+            mine = [i for i, h in enumerate(held) if h[0] == e.thread]
+            if len(mine) == 0:
+                return
+            thread, start, since = held[mine[-1]]
+            held[mine[-1]] = (e.to, start, time)
+            if self.trace is not None:
+                self.trace.Span(f"hold {self.LockName(e.id)}", "hold",
+                                thread, since, time,
+                                {"handed to": self.ThreadName(e.to)})
+
+    def Report(self) -> dict:
+        locks = []
+        for id in sorted(set(self.wait) | set(self.hold),
+                         key=lambda i: -self.wait[i].total):
+            locks.append({"id": id, "name": self.LockName(id),
+                          "wait": self.wait[id].Summary(self.unit),
+                          "hold": self.hold[id].Summary(self.unit),
+                          "failed": self.failed[id],
+                          "held at end": len(self.holders[id])})
+
+        pairs = []
+        for (waiter, id, holder), (count, total) in sorted(
+                self.pairs.items(), key=lambda p: -p[1][1])[:TOP]:
+            pairs.append({"waiter": self.ThreadName(waiter),
+                          "lock": self.LockName(id),
+                          "holder": self.ThreadName(holder),
+                          "count": count, "blocked": self.unit(total)})
+
+        chains = []
+        for chain, (count, total) in sorted(
+                self.chains.items(), key=lambda c: -c[1][1])[:TOP]:
+            path = [self.ThreadName(chain[0])]
+            for i in range(1, len(chain), 2):
+                path += [self.LockName(chain[i]),
+                         self.ThreadName(chain[i + 1])]
+            chains.append({"path": path, "count": count,
+                           "blocked": self.unit(total)})
+
+        return {"events": self.events, "locks": locks, "pairs": pairs,
+                "chains": chains}
+
+
+def PrintReport(report: dict, units: str) -> None:
+    print(f"{report['events']} events, times in {units}\n")
+
+    print("Locks by total wait")
+    for lock in report['locks']:
+        print(f"  [{lock['id']:03}] {lock['name']}")
+        for kind in ["wait", "hold"]:
+            s = lock[kind]
+            if s['count'] == 0:
+                print(f"      {kind:4} none")
+                continue
+            print(f"      {kind:4} n {s['count']} min {s['min']:.1f} "
+                  f"p50 {s['p50']:.1f} p90 {s['p90']:.1f} "
+                  f"p99 {s['p99']:.1f} max {s['max']:.1f} "
+                  f"total {s['total']:.1f}")
+        if lock['failed'] != 0:
+            print(f"      failed takes {lock['failed']}")
+        if lock['held at end'] != 0:
+            print(f"      still held at end of capture {lock['held at end']}")
+
+    print("\nTop contending thread pairs (waiter <- holder)")
+    for p in report['pairs']:
+        print(f"  {p['waiter']} <- {p['holder']} on {p['lock']}: "
+              f"{p['count']} times, {p['blocked']:.1f} blocked")
+
+    print("\nBlocking chains (waiter -> lock -> holder ...)")
+    for c in report['chains']:
+        print(f"  {' -> '.join(c['path'])}: {c['count']} times, "
+              f"{c['blocked']:.1f} blocked")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Report lock contention from locking trace events")
+    parser.add_argument("trace",
+                        help="raw locking event stream, or CTF trace folder "
+                        "with --ctf")
+    parser.add_argument("--json", dest="file_name",
+                        default=os.path.join(SCRIPT_PATH, "lockings.json"),
+                        help="lock definitions (for lock names)")
+    parser.add_argument("--ctf", action="store_true",
+                        help="read a CTF trace folder with babeltrace2")
+    parser.add_argument("--event-id", type=lambda x: int(x, 0),
+                        default=CTF_EVENT_ID,
+                        help="first CTF event ID (CONFIG_LOCKING_TRACING_EVENT_ID)")
+    parser.add_argument("--clock-hz", type=int, default=0,
+                        help="timestamp frequency, times are reported in "
+                        "microseconds when given (cycles otherwise)")
+    parser.add_argument("--thread-names",
+                        help="JSON object mapping thread addresses to names")
+    parser.add_argument("--perfetto",
+                        help="write a Chrome/Perfetto JSON timeline "
+                        "(requires --clock-hz)")
+    parser.add_argument("--report",
+                        help="write the report as JSON instead of printing it")
+    args = parser.parse_args()
+
+    if args.perfetto and args.clock_hz <= 0:
+        parser.error("--perfetto needs --clock-hz, the timeline is in "
+                     "microseconds")
+
+    lockNames = {p['x-id']: p['name'] for p in LoadLocks(args.file_name)}
+
+    threadNames = {}
+    if args.thread_names:
+        with open(args.thread_names, 'r') as f:
+            threadNames = {int(k, 0): v for k, v in json.load(f).items()}
+
+    if args.clock_hz > 0:
+        units = "us"
+        def unit(t): return t * 1000000 / args.clock_hz
+    else:
+        units = "cycles"
+        def unit(t): return float(t)
+
+    trace = timeline(args.perfetto, unit) if args.perfetto else None
+    a = analyzer(lockNames, threadNames, unit, trace)
+
+    if args.ctf:
+        events = ReadCtf(args.trace, threadNames)
+    else:
+        events = ReadRaw(args.trace, args.event_id)
+
+    for e in events:
+        a.Process(e)
+
+    if trace is not None:
+        trace.Close()
+
+    report = a.Report()
+    if args.report:
+        with open(args.report, 'w') as f:
+            json.dump(report, f, indent=2)
+    else:
+        PrintReport(report, units)
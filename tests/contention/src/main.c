@@ -0,0 +1,127 @@
+/**
+ * @file main.c
+ * @brief Cross-CPU cost of locks that share a cache line
+ *
+ * One thread per CPU takes and gives a lock as fast as it can. In the
+ * "separate" case each thread has its own lock, so any slowdown against a
+ * single CPU comes from the two lock slots (and their counters) sharing a
+ * cache line. The "shared" case takes the same lock on both CPUs for
+ * comparison. Build it packed and with --align (see testcase.yaml) and
+ * compare the ops/s of the separate case.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <sys/printk.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define CPUS 2
+#define RUN_MS 2000
+#define STACK_SIZE 1024
+#define PRIORITY 5
+
+BUILD_ASSERT(CONFIG_MP_NUM_CPUS >= CPUS, "Needs two CPUs");
+
+struct worker {
+	struct k_thread thread;
+	locking_id_t id;
+	uint32_t ops;
+	uint32_t failed;
+};
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+K_THREAD_STACK_ARRAY_DEFINE(stacks, CPUS, STACK_SIZE);
+static struct worker workers[CPUS];
+static atomic_t stop;
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static void worker_thread(void *p1, void *p2, void *p3);
+static void run(const char *name, locking_id_t a, locking_id_t b);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void main(void)
+{
+	run("separate", LOCKING_ID_hot_a, LOCKING_ID_hot_b);
+	run("shared", LOCKING_ID_hot_a, LOCKING_ID_hot_a);
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static void worker_thread(void *p1, void *p2, void *p3)
+{
+	struct worker *w = p1;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (!atomic_get(&stop)) {
+		if (locking_take(w->id, K_FOREVER) != 0) {
+			w->failed++;
+			continue;
+		}
+		(void)locking_give(w->id);
+		w->ops++;
+	}
+}
+
+static void run(const char *name, locking_id_t a, locking_id_t b)
+{
+	uint32_t ops = 0;
+	uint32_t failed = 0;
+	uint32_t start;
+	uint32_t elapsed;
+	int i;
+
+	atomic_set(&stop, 0);
+	for (i = 0; i < CPUS; i++) {
+		workers[i].id = (i == 0) ? a : b;
+		workers[i].ops = 0;
+		workers[i].failed = 0;
+		k_thread_create(&workers[i].thread, stacks[i],
+				K_THREAD_STACK_SIZEOF(stacks[i]), worker_thread,
+				&workers[i], NULL, NULL, PRIORITY, 0, K_FOREVER);
+		k_thread_cpu_mask_clear(&workers[i].thread);
+		k_thread_cpu_mask_enable(&workers[i].thread, i);
+	}
+
+	start = k_uptime_get_32();
+	for (i = 0; i < CPUS; i++) {
+		k_thread_start(&workers[i].thread);
+	}
+
+	k_sleep(K_MSEC(RUN_MS));
+	atomic_set(&stop, 1);
+
+	for (i = 0; i < CPUS; i++) {
+		k_thread_join(&workers[i].thread, K_FOREVER);
+		ops += workers[i].ops;
+		failed += workers[i].failed;
+	}
+	elapsed = MAX(k_uptime_get_32() - start, 1);
+
+	printk("contention {\"case\": \"%s\", \"aligned\": %s, "
+	       "\"objects\": %zu, \"padding\": %zu, \"ops\": %u, "
+	       "\"ops_per_s\": %u, \"failed\": %u}\n",
+	       name, (LOCKING_FOOTPRINT.aligned != 0) ? "true" : "false",
+	       LOCKING_FOOTPRINT.objects, LOCKING_FOOTPRINT.padding, ops,
+	       (uint32_t)(((uint64_t)ops * 1000) / elapsed), failed);
+}
@@ -0,0 +1,288 @@
+/**
+ * @file main.c
+ * @brief Snapshot command of the locking mcumgr group over SMP
+ *
+ * Requests go through the SMP layer like those of any other transport: a
+ * transport registered here feeds request packets to zephyr_smp_rx_req()
+ * and captures the response packet. The pages of the synthetic table are
+ * read with "start"/"count" and checked against "next"/"total".
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <ztest.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <net/buf.h>
+#include <mgmt/mgmt.h>
+#include <mgmt/mcumgr/buf.h>
+#include <mgmt/mcumgr/smp.h>
+#include <tinycbor/cbor.h>
+#include <tinycbor/cbor_buf_reader.h>
+#include <tinycbor/cbor_buf_writer.h>
+
+#include "locking_table.h"
+#include "locking.h"
+#include "locking_mgmt.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define PAGE CONFIG_LOCKING_MGMT_PAGE_SIZE
+
+/* Leave a parameter out of the request */
+#define UNSET UINT32_MAX
+
+BUILD_ASSERT(LOCKING_INDEX_COUNT > PAGE, "The table must take several pages");
+
+/* Decoded snapshot response */
+struct page {
+	/* mcumgr error, MGMT_ERR_EOK when the response has no "rc" */
+	uint64_t rc;
+	uint64_t total;
+	uint64_t next;
+	size_t locks;
+	/* "i" of the first lock of the page */
+	uint64_t first;
+};
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static struct zephyr_smp_transport transport;
+static K_SEM_DEFINE(response_sem, 0, 1);
+static uint8_t response[CONFIG_MCUMGR_BUF_SIZE];
+static size_t response_len;
+static uint8_t sequence;
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static int transport_out(struct zephyr_smp_transport *zst,
+			 struct net_buf *nb);
+static uint16_t transport_mtu(const struct net_buf *nb);
+static void snapshot(uint32_t start, uint32_t count, struct page *page);
+static void decode(const uint8_t *data, size_t len, struct page *page);
+
+static void test_first_page(void);
+static void test_pagination(void);
+static void test_count_capped(void);
+static void test_start_out_of_range(void);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void test_main(void)
+{
+	zephyr_smp_transport_init(&transport, transport_out, transport_mtu,
+				  NULL, NULL);
+
+	ztest_test_suite(mgmt, ztest_unit_test(test_first_page),
+			 ztest_unit_test(test_pagination),
+			 ztest_unit_test(test_count_capped),
+			 ztest_unit_test(test_start_out_of_range));
+	ztest_run_test_suite(mgmt);
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* Runs on the SMP work queue, the packet belongs to the transport */
+static int transport_out(struct zephyr_smp_transport *zst,
+			 struct net_buf *nb)
+{
+	ARG_UNUSED(zst);
+
+	response_len = MIN(nb->len, sizeof(response));
+	memcpy(response, nb->data, response_len);
+	mcumgr_buf_free(nb);
+	k_sem_give(&response_sem);
+
+	return 0;
+}
+
+static uint16_t transport_mtu(const struct net_buf *nb)
+{
+	ARG_UNUSED(nb);
+
+	return CONFIG_MCUMGR_BUF_SIZE;
+}
+
+static void snapshot(uint32_t start, uint32_t count, struct page *page)
+{
+	uint8_t payload[32];
+	struct cbor_buf_writer writer;
+	CborEncoder encoder;
+	CborEncoder map;
+	CborError err = CborNoError;
+	struct mgmt_hdr hdr;
+	struct net_buf *nb;
+	size_t len;
+
+	cbor_buf_writer_init(&writer, payload, sizeof(payload));
+	cbor_encoder_init(&encoder, &writer.enc, 0);
+	err |= cbor_encoder_create_map(&encoder, &map, CborIndefiniteLength);
+	if (start != UNSET) {
+		err |= cbor_encode_text_stringz(&map, "start");
+		err |= cbor_encode_uint(&map, start);
+	}
+	if (count != UNSET) {
+		err |= cbor_encode_text_stringz(&map, "count");
+		err |= cbor_encode_uint(&map, count);
+	}
+	err |= cbor_encoder_close_container(&encoder, &map);
+	zassert_equal(err, CborNoError, "Request not encoded");
+	len = cbor_buf_writer_buffer_size(&writer, payload);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.nh_op = MGMT_OP_READ;
+	hdr.nh_len = sys_cpu_to_be16(len);
+	hdr.nh_group = sys_cpu_to_be16(CONFIG_LOCKING_MGMT_GROUP_ID);
+	hdr.nh_seq = ++sequence;
+	hdr.nh_id = LOCKING_MGMT_ID_SNAPSHOT;
+
+	nb = mcumgr_buf_alloc();
+	zassert_not_null(nb, "No SMP buffer");
+	net_buf_add_mem(nb, &hdr, sizeof(hdr));
+	net_buf_add_mem(nb, payload, len);
+
+	k_sem_reset(&response_sem);
+	zephyr_smp_rx_req(&transport, nb);
+	zassert_equal(k_sem_take(&response_sem, K_SECONDS(1)), 0,
+		      "No response");
+
+	zassert_true(response_len >= sizeof(hdr), "Response too short");
+	memcpy(&hdr, response, sizeof(hdr));
+	zassert_equal(hdr.nh_op, MGMT_OP_READ_RSP, "Not a read response");
+	zassert_equal(sys_be16_to_cpu(hdr.nh_group),
+		      CONFIG_LOCKING_MGMT_GROUP_ID, "Wrong group");
+	zassert_equal(hdr.nh_seq, sequence, "Wrong sequence number");
+	zassert_equal(sys_be16_to_cpu(hdr.nh_len), response_len - sizeof(hdr),
+		      "Wrong length");
+
+	decode(&response[sizeof(hdr)], response_len - sizeof(hdr), page);
+}
+
+static void decode(const uint8_t *data, size_t len, struct page *page)
+{
+	struct cbor_buf_reader reader;
+	CborParser parser;
+	CborValue value;
+	CborValue field;
+	CborValue lock;
+	CborValue index;
+
+	memset(page, 0, sizeof(*page));
+
+	cbor_buf_reader_init(&reader, data, len);
+	zassert_equal(cbor_parser_init(&reader.r, 0, &parser, &value),
+		      CborNoError, "Response not CBOR");
+	zassert_true(cbor_value_is_map(&value), "Response not a map");
+
+	/* Errors only carry "rc" */
+	if (cbor_value_map_find_value(&value, "rc", &field) == CborNoError &&
+	    cbor_value_is_unsigned_integer(&field)) {
+		(void)cbor_value_get_uint64(&field, &page->rc);
+		return;
+	}
+
+	zassert_equal(cbor_value_map_find_value(&value, "total", &field),
+		      CborNoError, "No total");
+	zassert_equal(cbor_value_get_uint64(&field, &page->total),
+		      CborNoError, "total not an integer");
+
+	zassert_equal(cbor_value_map_find_value(&value, "next", &field),
+		      CborNoError, "No next");
+	zassert_equal(cbor_value_get_uint64(&field, &page->next), CborNoError,
+		      "next not an integer");
+
+	zassert_equal(cbor_value_map_find_value(&value, "locks", &field),
+		      CborNoError, "No locks");
+	zassert_true(cbor_value_is_array(&field), "locks not an array");
+	zassert_equal(cbor_value_get_array_length(&field, &page->locks),
+		      CborNoError, "locks has no length");
+
+	if (page->locks != 0) {
+		zassert_equal(cbor_value_enter_container(&field, &lock),
+			      CborNoError, "locks not readable");
+		zassert_equal(cbor_value_map_find_value(&lock, "i", &index),
+			      CborNoError, "Lock has no index");
+		zassert_equal(cbor_value_get_uint64(&index, &page->first),
+			      CborNoError, "Index not an integer");
+	}
+}
+
+static void test_first_page(void)
+{
+	struct page page;
+
+	snapshot(UNSET, UNSET, &page);
+
+	zassert_equal(page.rc, MGMT_ERR_EOK, "Request failed: %u",
+		      (uint32_t)page.rc);
+	zassert_equal(page.total, LOCKING_INDEX_COUNT, "Wrong total");
+	zassert_equal(page.next, PAGE, "A page is not the page size");
+	zassert_equal(page.locks, PAGE, "Wrong number of locks");
+	zassert_equal(page.first, 0, "Not the first lock");
+}
+
+static void test_pagination(void)
+{
+	const uint32_t count = PAGE - 1;
+	struct page page;
+	uint32_t start = 0;
+	size_t locks = 0;
+	uint32_t pages = 0;
+
+	do {
+		snapshot(start, count, &page);
+
+		zassert_equal(page.rc, MGMT_ERR_EOK, "Page %u failed", pages);
+		zassert_equal(page.total, LOCKING_INDEX_COUNT, "Wrong total");
+		zassert_equal(page.next, MIN(start + count, page.total),
+			      "Wrong next after %u", start);
+		zassert_equal(page.locks, page.next - start,
+			      "Page of %u has the wrong size", start);
+		zassert_equal(page.first, start, "Page doesn't start at %u",
+			      start);
+
+		locks += page.locks;
+		start = page.next;
+		pages++;
+	} while (page.next < page.total && pages <= LOCKING_INDEX_COUNT);
+
+	zassert_equal(locks, LOCKING_INDEX_COUNT, "Not every lock was read");
+	zassert_equal(pages, DIV_ROUND_UP(LOCKING_INDEX_COUNT, count),
+		      "Wrong number of pages");
+}
+
+static void test_count_capped(void)
+{
+	struct page page;
+
+	snapshot(0, LOCKING_INDEX_COUNT, &page);
+
+	zassert_equal(page.rc, MGMT_ERR_EOK, "Request failed");
+	zassert_equal(page.locks, PAGE, "Page larger than the page size");
+	zassert_equal(page.next, PAGE, "Wrong next");
+}
+
+static void test_start_out_of_range(void)
+{
+	struct page page;
+
+	/* The end of the table is an empty last page */
+	snapshot(LOCKING_INDEX_COUNT, UNSET, &page);
+	zassert_equal(page.rc, MGMT_ERR_EOK, "End of table refused");
+	zassert_equal(page.locks, 0, "Locks past the end");
+	zassert_equal(page.next, page.total, "Not the last page");
+
+	snapshot(LOCKING_INDEX_COUNT + 1, UNSET, &page);
+	zassert_equal(page.rc, MGMT_ERR_EINVAL, "Start past the end accepted");
+}
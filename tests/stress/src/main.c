@@ -0,0 +1,81 @@
+/**
+ * @file main.c
+ * @brief Stress test of a synthetic lock table
+ *
+ * Runs locking_stress() over the table made by locking_generator.py
+ * --synthesize (the size is set per scenario in testcase.yaml) and fails on
+ * any mutual exclusion, unit count or lost wakeup violation.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <ztest.h>
+
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define RUN_SECONDS 5
+
+/* Fixed so that a failure can be repeated with "locking stress" */
+#define SEED 0x1234567
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static void test_invalid_parameters(void);
+static void test_stress(void);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void test_main(void)
+{
+	ztest_test_suite(stress, ztest_unit_test(test_invalid_parameters),
+			 ztest_unit_test(test_stress));
+	ztest_run_test_suite(stress);
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static void test_invalid_parameters(void)
+{
+	struct locking_stress_result result;
+
+	zassert_equal(locking_stress(0, 1, SEED, &result), -EINVAL,
+		      "No threads accepted");
+	zassert_equal(locking_stress(CONFIG_LOCKING_STRESS_THREADS + 1, 1, SEED,
+				     &result),
+		      -EINVAL, "Too many threads accepted");
+	zassert_equal(locking_stress(1, 0, SEED, &result), -EINVAL,
+		      "No duration accepted");
+	zassert_equal(locking_stress(1, 1, 0, &result), -EINVAL,
+		      "Zero seed accepted");
+	zassert_equal(locking_stress(1, 1, SEED, NULL), -EINVAL,
+		      "No result accepted");
+}
+
+static void test_stress(void)
+{
+	struct locking_stress_result result;
+	int r;
+
+	r = locking_stress(CONFIG_LOCKING_STRESS_THREADS, RUN_SECONDS, SEED,
+			   &result);
+
+	TC_PRINT("%u locks, %u threads: %u ops in %u ms, %u lost wakeups, "
+		 "%u violations\n",
+		 LOCKING_TABLE_SIZE, CONFIG_LOCKING_STRESS_THREADS, result.ops,
+		 result.elapsed_ms, result.lost_wakeups, result.violations);
+
+	zassert_equal(r, 0, "Stress test failed: %d", r);
+	zassert_true(result.ops > 0, "No lock was taken");
+}
@@ -26,6 +26,67 @@ extern "C" {
 
 #include "locking_table.h"
 
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Number of table indices, runtime created locks follow the generated ones */
+#ifdef CONFIG_LOCKING_DYNAMIC
+#define LOCKING_INDEX_COUNT (LOCKING_TABLE_SIZE + CONFIG_LOCKING_DYNAMIC_COUNT)
+#else
+#define LOCKING_INDEX_COUNT LOCKING_TABLE_SIZE
+#endif
+
+/* State of one lock at the time of a snapshot */
+struct locking_state {
+	locking_index_t index;
+	locking_id_t id;
+	enum locking_type type;
+	/* Mutex or ticket owner, or the thread running the sections of a
+	 * combining lock (NULL when not held)
+	 */
+	struct k_thread *owner;
+	/* Mutex recursion count */
+	uint32_t lock_count;
+	/* Semaphore units available */
+	uint32_t free;
+	/* Threads blocked on the lock */
+	uint16_t waiters;
+};
+
+#ifdef CONFIG_LOCKING_ASYNC
+struct locking_async;
+
+/**
+ * @brief Called from the system work queue with the lock held, the callback
+ *        (or work it schedules on the same work queue) must give the lock.
+ */
+typedef void (*locking_async_cb_t)(struct locking_async *req);
+
+/* Asynchronous lock request, owned by the caller until it completes or is
+ * cancelled. Fields are private.
+ */
+struct locking_async {
+	struct k_work work;
+	sys_dnode_t node;
+	locking_async_cb_t callback;
+	locking_id_t id;
+	int priority;
+	bool granted;
+};
+#endif
+
+#ifdef CONFIG_LOCKING_STRESS
+/* Outcome of a locking_stress() run */
+struct locking_stress_result {
+	uint32_t ops;
+	uint32_t elapsed_ms;
+	/* Takes that timed out although locks are only held briefly */
+	uint32_t lost_wakeups;
+	/* Mutual exclusion, unit count and give failures */
+	uint32_t violations;
+};
+#endif
+
 /******************************************************************************/
 /* Function Definitions                                                       */
 /******************************************************************************/
@@ -77,9 +138,457 @@ int locking_take(locking_id_t id, k_timeout_t wait_time);
  */
 int locking_give(locking_id_t id);
 
-#ifdef CONFIG_LOCKING_SHELL
+#ifdef CONFIG_LOCKING_HANDOFF
+/**
+ * @brief Hand a held lock to another thread without giving it, no other
+ *        thread can take it in between. The caller drops back to its own
+ *        priority and the new owner inherits from the waiters. A semaphore
+ *        (which has no owner) only moves the caller's holder record, so it
+ *        needs CONFIG_LOCKING_HOLDERS.
+ *
+ *        Mutexes cannot be handed over. A lock that is passed between
+ *        threads should be a "pi_semaphore" (CONFIG_LOCKING_PI_SEMAPHORE),
+ *        which keeps priority inheritance across the handoff, or a ticket
+ *        lock where no inheritance is needed.
+ *
+ * @param id A semaphore, ticket or pi_semaphore lock ID, not striped.
+ * @param to New owner, not the calling thread.
+ *
+ * @retval 0 on success, -EPERM the calling thread does not hold the lock,
+ *         -EBUSY to is waiting for the lock, -EALREADY a pi_semaphore that
+ *         is not taken, -ENOTSUP mutexes, other types and semaphores
+ *         without holder records, -EINVAL invalid or striped ID, NULL to,
+ *         to is the calling thread or called from an ISR.
+ */
+int locking_handoff(locking_id_t id, struct k_thread *to);
+#endif
+
+/**
+ * @brief Capture the state of locks with index [start, start + n) in a single
+ *        pass under a spinlock.
+ *
+ * @param start Table index of the first lock.
+ * @param out Buffer for the lock states.
+ * @param n Number of entries in out.
+ *
+ * @retval negative error code, number of states written on success.
+ *
+ * @note On SMP targets the kernel may still update a lock on another CPU
+ * during the pass; the snapshot is coherent on single core targets.
+ */
+int locking_snapshot_range(locking_index_t start, struct locking_state *out,
+			   size_t n);
+
+/**
+ * @brief Capture the state of all locks (up to n) in a single pass.
+ *
+ * @param out Buffer for the lock states, indexed by table index.
+ * @param n Number of entries in out (LOCKING_INDEX_COUNT for all locks).
+ *
+ * @retval negative error code, number of states written on success.
+ */
+int locking_snapshot(struct locking_state *out, size_t n);
+
+/**
+ * @brief Capture only the locks that changed since the previous snapshot.
+ *
+ * @param previous Caller owned snapshot of LOCKING_INDEX_COUNT entries (from
+ *        locking_snapshot), updated with the changed entries.
+ * @param out Buffer for the changed lock states.
+ * @param n Number of entries in out.
+ *
+ * @retval negative error code, number of changed states written on success.
+ *
+ * @note If out fills up the remaining changes are reported by the next call.
+ */
+int locking_snapshot_delta(struct locking_state *previous,
+			   struct locking_state *out, size_t n);
+
+#ifdef CONFIG_LOCKING_TAKE_ANY
+/**
+ * @brief Take whichever of several semaphore locks becomes available first.
+ *
+ * Blocks once (using k_poll) on all of the semaphores and takes exactly one
+ * of them, no other lock in the set is taken.
+ *
+ * @param ids Semaphore lock IDs (at most CONFIG_LOCKING_TAKE_ANY_MAX).
+ * @param n Number of IDs.
+ * @param timeout The time to wait for any of the locks.
+ * @param got Set to the ID of the lock that was taken.
+ *
+ * @retval 0 on success, -EBUSY none available and timeout is K_NO_WAIT,
+ *         -EAGAIN on timeout, -ENOTSUP if an ID is not a semaphore, other
+ *         negative error code on failure.
+ */
+int locking_take_any(const locking_id_t *ids, size_t n, k_timeout_t timeout,
+		     locking_id_t *got);
+#endif
+
+#ifdef CONFIG_LOCKING_COMBINING
+/**
+ * @brief Run a critical section under a combining lock.
+ *
+ * If the lock is held, fn is handed to the holder which runs it together
+ * with the sections of other waiting threads, and the caller sleeps until
+ * it has completed. Combining locks can't be taken or given directly.
+ *
+ * @param id A combining lock ID.
+ * @param fn Critical section, it may run in another thread so it must be
+ *        short, must not block and must not use the caller's thread identity.
+ * @param arg Passed to fn.
+ *
+ * @retval 0 once fn has completed, -ENOTSUP if the ID is not a combining
+ *         lock, -EDEADLK if called from a section of the same lock,
+ *         -EWOULDBLOCK if called from an ISR (the caller may have to sleep),
+ *         other negative error code on failure.
+ */
+int locking_execute(locking_id_t id, locking_combining_fn_t fn, void *arg);
+#endif
+
+#ifdef CONFIG_LOCKING_POOL
+/**
+ * @brief Wait for a free slot of a pool lock and claim it.
+ *
+ * The slot is found with a find-first-set over the pool's free bitmap, so
+ * no other lock or scan is needed to pick a buffer.
+ *
+ * @param id A pool lock ID.
+ * @param wait_time The time to wait for a slot.
+ * @param slot Set to the slot index, less than the pool limit.
+ *
+ * @retval 0 on success, -EAGAIN on timeout (-EBUSY with K_NO_WAIT),
+ *         -ENOTSUP if the ID is not a pool, other negative error code on
+ *         failure.
+ */
+int locking_take_slot(locking_id_t id, k_timeout_t wait_time, uint16_t *slot);
+
+/**
+ * @brief Release a slot of a pool lock.
+ *
+ * @param id A pool lock ID.
+ * @param slot Index returned by locking_take_slot().
+ *
+ * @retval 0 on success, -EALREADY if the slot is already free, -EPERM if
+ *         another thread holds it (CONFIG_LOCKING_POOL_CHECKS), -ENOTSUP if
+ *         the ID is not a pool, other negative error code on failure.
+ */
+int locking_give_slot(locking_id_t id, uint16_t slot);
+#endif
+
+#ifdef CONFIG_LOCKING_BARRIER
+/**
+ * @brief Wait at a barrier until every party (the limit of the lock) has
+ *        arrived.
+ *
+ * @param id A barrier lock ID.
+ * @param timeout The time to wait for the other parties, a party that
+ *        times out ends the phase for the others with -ECANCELED.
+ *
+ * @retval 0 when every party arrived, -EAGAIN timed out, -ECANCELED the
+ *         phase was broken, -ENOTSUP not a barrier, -EINVAL invalid ID.
+ */
+int locking_barrier_wait(locking_id_t id, k_timeout_t timeout);
+
+/**
+ * @brief Count a latch down, it opens when the count (from the lock table)
+ *        reaches zero. A latch is not re-armed. Can be called from an ISR.
+ *
+ * @param id A latch lock ID.
+ *
+ * @retval 0 on success, -EALREADY latch already open, -ENOTSUP not a latch,
+ *         -EINVAL invalid ID.
+ */
+int locking_latch_countdown(locking_id_t id);
+
+/**
+ * @brief Wait until a latch is open.
+ *
+ * @param id A latch lock ID.
+ * @param timeout The time to wait.
+ *
+ * @retval 0 once open, -EAGAIN timed out, -ENOTSUP not a latch,
+ *         -EINVAL invalid ID.
+ */
+int locking_latch_wait(locking_id_t id, k_timeout_t timeout);
+#endif
+
+#ifdef CONFIG_LOCKING_STRIPED
+/**
+ * @brief Get the number of lock objects (stripes) of a lock, locks without
+ *        x-instances have one.
+ *
+ * @param id A lock ID.
+ *
+ * @retval Number of stripes, 0 if the ID is invalid.
+ */
+uint16_t locking_get_stripes(locking_id_t id);
+
+/**
+ * @brief Take one stripe of a striped lock. locking_take() and
+ *        locking_give() use stripe 0.
+ *
+ * @param id A lock ID.
+ * @param i Stripe, less than locking_get_stripes().
+ * @param wait_time The time to wait to take the stripe.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_take_idx(locking_id_t id, uint16_t i, k_timeout_t wait_time);
+
+/**
+ * @brief Give one stripe of a striped lock.
+ *
+ * @param id A lock ID.
+ * @param i Stripe, less than locking_get_stripes().
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_give_idx(locking_id_t id, uint16_t i);
+
+/**
+ * @brief Take the stripe that a key (e.g. a channel number or connection
+ *        handle) hashes to. The same key always maps to the same stripe.
+ *
+ * @param id A lock ID.
+ * @param key Key of the protected item.
+ * @param wait_time The time to wait to take the stripe.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_take_key(locking_id_t id, uint32_t key, k_timeout_t wait_time);
+
+/**
+ * @brief Give the stripe that a key hashes to.
+ *
+ * @param id A lock ID.
+ * @param key Key passed to locking_take_key().
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_give_key(locking_id_t id, uint32_t key);
+#endif
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+/**
+ * @brief Change how much a lock is instrumented. Below
+ *        LOCKING_INSTRUMENT_COUNTERS a take or give only costs the check
+ *        of the level. A lock already held when timing is enabled is not
+ *        timed until it is taken again.
+ *
+ * @param id A lock ID.
+ * @param level New level, up to the x-instrument level of the lock
+ *        (LOCKING_INSTRUMENT_TRACE for locks created at runtime).
+ *
+ * @retval -EINVAL invalid ID, -ENOTSUP level above the x-instrument level,
+ *         0 on success.
+ */
+int locking_set_instrument(locking_id_t id, enum locking_instrument level);
+
+/**
+ * @brief Get how much a lock is instrumented.
+ *
+ * @param id A lock ID.
+ * @param level Set to the current level, may be NULL.
+ * @param max Set to the x-instrument level, may be NULL.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_get_instrument(locking_id_t id, enum locking_instrument *level,
+			   enum locking_instrument *max);
+#endif
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+/**
+ * @brief Get where the owner of a mutex or ticket lock took it.
+ *
+ * @param id A lock ID.
+ *
+ * @retval Return address of the outermost locking_take() of the current
+ *         owner (of the last take if the lock is free), NULL if unknown.
+ *         Striped locks are not recorded, their stripes have separate
+ *         owners.
+ */
+void *locking_get_call_site(locking_id_t id);
+
+/**
+ * @brief Log every mutex and ticket lock that is held, with its owner and
+ *        where it was taken. Intended for watchdog and fault handlers, it
+ *        does not block.
+ *
+ * @retval Number of locks held.
+ */
+int locking_log_owners(void);
+#endif
+
+#ifdef CONFIG_LOCKING_ASYNC
+/**
+ * @brief Take a lock without blocking the caller.
+ *
+ * If the lock is free (and no other asynchronous request is queued for it)
+ * it is taken immediately by the calling thread and the callback is not
+ * used. Otherwise the request is queued and, once the lock is given,
+ * requests are granted in priority order (priority of the requesting
+ * thread, FIFO for equal priorities): the callback then runs on the system
+ * work queue with the lock held by the work queue thread. A mutex held by
+ * one request is never granted recursively to another request.
+ *
+ * @param id A mutex, semaphore, ticket or pi_semaphore lock ID.
+ * @param req Request, must stay valid until the callback has run or the
+ *        request has been cancelled.
+ * @param callback Function to run once the lock is held.
+ *
+ * @retval 0 if the lock was taken immediately, -EINPROGRESS if the request
+ *         was queued, -ENOTSUP other lock types, other negative error code
+ *         on failure.
+ */
+int locking_take_async(locking_id_t id, struct locking_async *req,
+		       locking_async_cb_t callback);
+
+/**
+ * @brief Cancel a queued asynchronous request. Waits for a handler that is
+ *        already trying the request, req must stay valid until the call
+ *        returns 0.
+ *
+ * @param req Request passed to locking_take_async.
+ *
+ * @retval 0 on success, -EALREADY if the lock has already been granted to
+ *         the request (its callback has run or is running), -EBUSY called
+ *         from an ISR while the handler runs (the request is cancelled,
+ *         call again until it returns 0 before reusing req).
+ */
+int locking_cancel_async(struct locking_async *req);
+#endif /* CONFIG_LOCKING_ASYNC */
+
+#ifdef CONFIG_LOCKING_DYNAMIC
+/**
+ * @brief Create a lock at runtime. The lock object comes from a fixed pool
+ *        (CONFIG_LOCKING_DYNAMIC_COUNT), nothing is allocated from the heap.
+ *
+ * The ID is above LOCKING_TABLE_MAX_ID and is used with the rest of the API
+ * like a generated lock. IDs are not reused straight away, so an ID kept
+ * after locking_destroy() is rejected rather than mapping to a new lock.
+ *
+ * @param type LOCKING_TYPE_MUTEX, LOCKING_TYPE_SEMAPHORE,
+ *        LOCKING_TYPE_TICKET or LOCKING_TYPE_COMBINING.
+ * @param count Initial count of a semaphore (bypass of a ticket lock).
+ * @param limit Limit of a semaphore.
+ * @param name Name (copied, truncated to CONFIG_LOCKING_DYNAMIC_NAME_SIZE).
+ *
+ * @retval ID of the lock, LOCKING_INVALID_ID if the pool is exhausted or
+ *         the parameters are invalid.
+ */
+locking_id_t locking_create(enum locking_type type, uint8_t count,
+			    uint8_t limit, const char *name);
+
+/**
+ * @brief Destroy a lock created by locking_create and return it to the pool.
+ *
+ * @param id ID returned by locking_create.
+ *
+ * @retval 0 on success, -EINVAL if the ID is not a runtime lock (or was
+ *         already destroyed), -EBUSY if the lock is held, waited for or
+ *         a take or give of it is in progress.
+ *
+ * @note A take or give racing the destroy either completes first (and the
+ *       destroy fails) or fails with -EINVAL. An ID kept after the destroy
+ *       can map to a new lock once the slot's generation count wraps.
+ */
+int locking_destroy(locking_id_t id);
+#endif
+
+#ifdef CONFIG_LOCKING_PERSIST
+/**
+ * @brief Copy the counters of every lock into no-init RAM. Called
+ *        periodically (CONFIG_LOCKING_PERSIST_INTERVAL_MS), call it from a
+ *        watchdog or fault handler to save the latest counters before a
+ *        reset. Does not block.
+ */
+void locking_persist_save(void);
+
+/**
+ * @brief Get the counters of a lock saved in the previous boot.
+ *
+ * @param index Table index (the table layout is checked at boot).
+ * @param out Destination, id is LOCKING_INVALID_ID for an unused slot.
+ *
+ * @retval -ENODATA no previous boot data (cold boot, layout changed or the
+ *         counters failed their CRC), -EINVAL invalid parameter, 0 on
+ *         success.
+ */
+int locking_previous_counters(locking_index_t index,
+			      struct locking_counters *out);
+
+/**
+ * @brief Get the last lock events of the previous boot, oldest first. Events
+ *        torn by the reset are left out.
+ *
+ * @param out Destination.
+ * @param n Number of entries in out.
+ *
+ * @retval Number of events copied, -ENODATA no previous boot data,
+ *         -EINVAL invalid parameter.
+ */
+int locking_previous_events(struct locking_event *out, size_t n);
+#endif
+
+#ifdef CONFIG_LOCKING_BENCH
+/**
+ * @brief Measure the cost of the lock table: the boot time of
+ *        locking_table_initialise() and the average time of locking_map()
+ *        over every ID up to the largest (valid or not) and of
+ *        locking_get_id() over a sample of the names.
+ *
+ * @param out Destination.
+ *
+ * @retval 0 on success.
+ */
+int locking_bench(struct locking_bench *out);
+#endif
+
+#ifdef CONFIG_LOCKING_BLAME
+/**
+ * @brief Clear the blame matrix, threads and locks are recorded again from
+ *        their next take.
+ */
+void locking_blame_clear(void);
+#endif
+
+#ifdef CONFIG_LOCKING_STRESS
+/**
+ * @brief Take and give random locks from several threads, checking mutual
+ *        exclusion, semaphore units and wakeups. The first violations are
+ *        logged.
+ *
+ * Locks held before the run (and semaphores without free units) are skipped.
+ * Only meant for test builds, the application's locks are really taken.
+ *
+ * @param threads Number of worker threads (up to CONFIG_LOCKING_STRESS_THREADS).
+ * @param seconds Duration of the run.
+ * @param seed Seed of the random lock selection (must not be 0).
+ * @param out Counts of the run, also filled in when a check failed.
+ *
+ * @retval negative error code, 0 on success (-EFAULT if a check failed).
+ */
+int locking_stress(uint8_t threads, uint32_t seconds, uint32_t seed,
+		   struct locking_stress_result *out);
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+/**
+ * @brief Get the threads holding units of a semaphore lock.
+ *
+ * @param id A semaphore lock ID.
+ * @param out Buffer for the holder records.
+ * @param n Number of entries in out (the lock limit covers every unit).
+ *
+ * @retval negative error code, number of records written on success.
+ */
+int locking_get_holders(locking_id_t id, struct locking_holder *out, size_t n);
+#endif
+
 /**
- * @brief Get the id of a lock
+ * @brief Get the id of a lock, LOCKING_INVALID_ID without
+ *        CONFIG_LOCKING_STRING_NAME
  *
  * @param name Name of the lock.
  *
@@ -87,6 +596,7 @@ int locking_give(locking_id_t id);
  */
 locking_id_t locking_get_id(const char *name);
 
+#ifdef CONFIG_LOCKING_SHELL
 /**
  * @brief Print the details of a lock
  *
@@ -105,9 +615,81 @@ int locking_show(const struct shell *shell, locking_id_t id);
  * @retval negative error code, 0 on success.
  *
  * @note For remote execution using mcumgr, SHELL_BACKEND_DUMMY_BUF_SIZE
- * must be set large enough to display all values.
+ * must be set large enough to display all values. CONFIG_LOCKING_MGMT
+ * provides the same information as a paged CBOR snapshot instead.
  */
 int locking_show_all(const struct shell *shell);
+
+/**
+ * @brief Print the RAM used by the lock objects, including the padding spent
+ *        on cache line aligned locks.
+ *
+ * @param shell Pointer to shell instance.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_show_memory(const struct shell *shell);
+
+#ifdef CONFIG_LOCKING_STATS
+/**
+ * @brief Print the usage profile of every lock, one JSON object per line
+ *        prefixed with "profile", for locking_advisor.py.
+ *
+ * @param shell Pointer to shell instance.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_show_profile(const struct shell *shell);
+#endif
+
+#ifdef CONFIG_LOCKING_BENCH
+/**
+ * @brief Run locking_bench() and print the result with the footprint as a
+ *        JSON object prefixed with "bench", for locking_bench.py.
+ *
+ * @param shell Pointer to shell instance.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_show_bench(const struct shell *shell);
+#endif
+
+#ifdef CONFIG_LOCKING_BLAME
+/**
+ * @brief Print the takes and blocked time of threads on each lock, with
+ *        their CPU time when CONFIG_THREAD_RUNTIME_STATS is enabled.
+ *
+ * @param shell Pointer to shell instance.
+ * @param thread Thread name or address, NULL for every thread.
+ *
+ * @retval -ENOENT the thread has not taken a lock, 0 on success.
+ */
+int locking_show_blame(const struct shell *shell, const char *thread);
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+/**
+ * @brief Print the threads holding units of a semaphore lock, with how long
+ *        they have held them and where they were taken.
+ *
+ * @param shell Pointer to shell instance.
+ * @param id A semaphore lock ID.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_show_holders(const struct shell *shell, locking_id_t id);
+#endif
+
+#ifdef CONFIG_LOCKING_PERSIST
+/**
+ * @brief Print the counters and events saved in the previous boot.
+ *
+ * @param shell Pointer to shell instance.
+ *
+ * @retval -ENODATA no previous boot data, 0 on success.
+ */
+int locking_show_previous(const struct shell *shell);
+#endif
 #endif /* CONFIG_LOCKING_SHELL */
 
 #ifdef __cplusplus
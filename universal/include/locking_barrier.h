@@ -0,0 +1,127 @@
+/**
+ * @file locking_barrier.h
+ *
+ * @brief Barrier and latch, phase synchronisation of a group of threads
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_BARRIER_H__
+#define __LOCKING_BARRIER_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <sys/slist.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Fields are private, use the functions below or the locking API. */
+struct locking_barrier {
+	struct k_mutex lock;
+	struct k_condvar cond;
+	uint8_t parties;
+	uint8_t arrived;
+	/* Parties waiting in the current phase, each is told at the end of
+	 * the phase whether it was broken.
+	 */
+	sys_slist_t waiters;
+};
+
+/* Fields are private, use the functions below or the locking API. */
+struct locking_latch {
+	struct k_spinlock lock;
+	/* Given once when the count reaches zero, each waiter that takes it
+	 * gives it back for the next one.
+	 */
+	struct k_sem gate;
+	uint8_t initial;
+	uint8_t count;
+};
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Initialise a barrier.
+ *
+ * @param barrier Barrier.
+ * @param parties Number of threads that wait for each other in a phase.
+ */
+void locking_barrier_init(struct locking_barrier *barrier, uint8_t parties);
+
+/**
+ * @brief End the current phase as broken (debug use only), threads waiting
+ *        return -ECANCELED.
+ *
+ * @param barrier Barrier.
+ */
+void locking_barrier_reset(struct locking_barrier *barrier);
+
+/**
+ * @brief Wait until every party has arrived. The last party to arrive wakes
+ *        the others with one broadcast and the barrier is ready for the
+ *        next phase.
+ *
+ * A party that times out ends the phase as broken so that the others are
+ * not left waiting for it.
+ *
+ * @param barrier Barrier.
+ * @param timeout The time to wait for the other parties.
+ *
+ * @retval 0 when every party arrived, -EAGAIN this party timed out,
+ *         -ECANCELED the phase was broken by another party (or a reset).
+ */
+int locking_barrier_wait_object(struct locking_barrier *barrier,
+				k_timeout_t timeout);
+
+/**
+ * @brief Initialise a latch.
+ *
+ * @param latch Latch.
+ * @param count Number of count downs that open the latch.
+ */
+void locking_latch_init(struct locking_latch *latch, uint8_t count);
+
+/**
+ * @brief Re-arm a latch with its initial count (debug use only).
+ *
+ * @param latch Latch.
+ */
+void locking_latch_reset(struct locking_latch *latch);
+
+/**
+ * @brief Count a latch down, the count down that reaches zero opens the
+ *        gate that every waiting thread passes in turn. Can be called from
+ *        an ISR.
+ *
+ * @param latch Latch.
+ *
+ * @retval -EALREADY the latch is already open, 0 on success.
+ */
+int locking_latch_countdown_object(struct locking_latch *latch);
+
+/**
+ * @brief Wait until a latch is open (its count is zero).
+ *
+ * @param latch Latch.
+ * @param timeout The time to wait.
+ *
+ * @retval -EAGAIN timed out, 0 once the latch is open.
+ */
+int locking_latch_wait_object(struct locking_latch *latch,
+			      k_timeout_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_BARRIER_H__ */
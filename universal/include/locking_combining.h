@@ -0,0 +1,100 @@
+/**
+ * @file locking_combining.h
+ *
+ * @brief Combining (delegation) lock, the holder runs the critical sections
+ *        of the threads waiting for it
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_COMBINING_H__
+#define __LOCKING_COMBINING_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <sys/slist.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/**
+ * @brief A critical section. It may run in another thread (whichever holds
+ *        the lock), so it must be short, must not block and must not depend
+ *        on the identity or stack of the calling thread.
+ */
+typedef void (*locking_combining_fn_t)(void *arg);
+
+struct locking_combining_metrics {
+	/* Critical sections run */
+	uint32_t ops;
+	/* Critical sections run on behalf of another thread */
+	uint32_t combined;
+	/* Times a thread held the lock, and the most sections it ran */
+	uint32_t batches;
+	uint32_t max_batch;
+	/* Times the holder passed the lock on to a waiter to bound its work */
+	uint32_t handoffs;
+};
+
+/* Fields are private, use the functions below or the locking API. */
+struct locking_combining {
+	struct k_spinlock lock;
+	/* Published critical sections, in arrival order */
+	sys_slist_t pending;
+	uint16_t waiting;
+	/* Thread running critical sections (NULL when free) */
+	struct k_thread *combiner;
+	struct locking_combining_metrics metrics;
+};
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Initialise a combining lock.
+ *
+ * @param combining Combining lock.
+ */
+void locking_combining_init(struct locking_combining *combining);
+
+/**
+ * @brief Run a critical section under a combining lock. When the lock is
+ *        free the section runs in the calling thread, which then also runs
+ *        every section published while it held the lock. Otherwise the
+ *        section is published and the caller sleeps until the holder has
+ *        run it.
+ *
+ * @param combining Combining lock.
+ * @param fn Critical section.
+ * @param arg Passed to fn.
+ * @param contended Set when the section had to wait for another thread.
+ *
+ * @retval -EDEADLK called from a critical section of the same lock,
+ *         -EWOULDBLOCK called from an ISR, 0 once fn has completed.
+ */
+int locking_combining_execute(struct locking_combining *combining,
+			      locking_combining_fn_t fn, void *arg,
+			      bool *contended);
+
+/**
+ * @brief Copy the batching metrics of a combining lock.
+ *
+ * @param combining Combining lock.
+ * @param metrics Destination.
+ */
+void locking_combining_metrics_get(struct locking_combining *combining,
+				   struct locking_combining_metrics *metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_COMBINING_H__ */
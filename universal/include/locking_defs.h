@@ -16,6 +16,13 @@
 #include <zephyr/types.h>
 #include <stddef.h>
 
+#include "locking_ticket.h"
+#include "locking_combining.h"
+#include "locking_pool.h"
+#include "locking_barrier.h"
+#include "locking_rate.h"
+#include "locking_pi_sem.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -32,25 +39,228 @@ enum locking_type {
 	LOCKING_TYPE_UNKNOWN = 0,
 	LOCKING_TYPE_ANY,
 	LOCKING_TYPE_MUTEX,
-	LOCKING_TYPE_SEMAPHORE
+	LOCKING_TYPE_SEMAPHORE,
+	LOCKING_TYPE_TICKET,
+	LOCKING_TYPE_COMBINING,
+	LOCKING_TYPE_POOL,
+	LOCKING_TYPE_BARRIER,
+	LOCKING_TYPE_LATCH,
+	LOCKING_TYPE_RATE,
+	LOCKING_TYPE_PI_SEMAPHORE
 };
 
 enum locking_size {
 	LOCKING_SIZE_UNKNOWN = 0,
 	LOCKING_SIZE_MUTEX = sizeof(struct k_mutex),
 	LOCKING_SIZE_SEMAPHORE = sizeof(struct k_sem),
+	LOCKING_SIZE_TICKET = sizeof(struct locking_ticket),
+	LOCKING_SIZE_COMBINING = sizeof(struct locking_combining),
+	LOCKING_SIZE_POOL = sizeof(struct locking_pool),
+	LOCKING_SIZE_BARRIER = sizeof(struct locking_barrier),
+	LOCKING_SIZE_LATCH = sizeof(struct locking_latch),
+	LOCKING_SIZE_RATE = sizeof(struct locking_rate),
+	LOCKING_SIZE_PI_SEMAPHORE = sizeof(struct locking_pi_sem),
+};
+
+/* How much a lock is instrumented (x-instrument), each level includes the
+ * ones before it.
+ */
+enum locking_instrument {
+	LOCKING_INSTRUMENT_NONE = 0,
+	/* Statistics counters (CONFIG_LOCKING_STATS) */
+	LOCKING_INSTRUMENT_COUNTERS,
+	/* Longest wait and hold (CONFIG_LOCKING_INSTRUMENT) */
+	LOCKING_INSTRUMENT_TIMING,
+	/* Trace events and verbose debugging output */
+	LOCKING_INSTRUMENT_TRACE
+};
+
+#ifdef CONFIG_LOCKING_STATS
+struct locking_stats {
+	atomic_t takes;
+	atomic_t gives;
+	atomic_t contended;
+	atomic_t timeouts;
+	/* Times a holder passed the lock to another thread */
+	atomic_t handoffs;
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	/* Longest wait for and hold of the lock in cycles */
+	atomic_t wait_max;
+	atomic_t hold_max;
+	/* Takes from an ISR, most recursive takes of a mutex or units of a
+	 * semaphore held at once
+	 */
+	atomic_t isr_takes;
+	atomic_t depth_max;
+	/* Cycle count when the lock was taken (exclusive types only) */
+	uint32_t held_since;
+#endif
+};
+
+#define LOCKING_STATS_SIZE sizeof(struct locking_stats)
+#define LOCKING_SLOT_MEMBERS(kind)                                             \
+	kind lock;                                                             \
+	struct locking_stats stats;
+#else
+#define LOCKING_STATS_SIZE 0
+#define LOCKING_SLOT_MEMBERS(kind) kind lock;
+#endif
+
+/* A lock object and its statistics, packed with its neighbours. */
+#define LOCKING_SLOT(kind) struct { LOCKING_SLOT_MEMBERS(kind) }
+
+/* A lock object and its statistics, padded out to whole cache lines so that
+ * it never shares a line with another lock (avoids false sharing on SMP).
+ */
+#define LOCKING_SLOT_ALIGNED(kind)                                             \
+	struct __aligned(CONFIG_LOCKING_CACHE_LINE_SIZE) {                     \
+		LOCKING_SLOT_MEMBERS(kind)                                     \
+	}
+
+/* Bytes of a slot that are not padding. */
+#define LOCKING_SLOT_PAYLOAD(n) (sizeof((n).lock) + LOCKING_STATS_SIZE)
+
+#ifdef CONFIG_LOCKING_HOLDERS
+/* One outstanding unit of a semaphore */
+struct locking_holder {
+	/* NULL when taken from an ISR */
+	struct k_thread *thread;
+	/* k_uptime_get_32() when the unit was taken */
+	uint32_t since;
+	/* Return address of the locking_take() call */
+	void *call_site;
+};
+
+/* Links of a holder record. Records are numbered from 1 so that 0 (none)
+ * is the zero initialised state.
+ */
+struct locking_holder_links {
+	/* Records in use in take order */
+	uint8_t prev;
+	uint8_t next;
+	/* Records of the same thread, or the free list (older only) */
+	uint8_t older;
+	uint8_t newer;
+};
+
+/* Holder records of one semaphore, one per unit (limit) */
+struct locking_holders {
+	struct k_spinlock lock;
+	const uint8_t size;
+	/* Untracked units, taken while every record was in use */
+	uint8_t untracked;
+	/* Records in use, oldest and newest */
+	uint8_t first;
+	uint8_t last;
+	/* Free list, and the records that were never used start at fresh */
+	uint8_t free;
+	uint8_t fresh;
+	const uint16_t map_size;
+	struct locking_holder *const holder;
+	struct locking_holder_links *const links;
+	/* Open addressed map of threads to their newest record, at most half
+	 * full so that lookups stay short.
+	 */
+	uint8_t *const map;
+};
+
+#define LOCKING_HOLDERS_DEFINE(n, limit)                                       \
+	static struct locking_holder n##_holder[limit];                        \
+	static struct locking_holder_links n##_links[limit];                   \
+	static uint8_t n##_map[2 * (limit)];                                   \
+	static struct locking_holders n##_holders = {                          \
+		.size = limit,                                                 \
+		.map_size = 2 * (limit),                                       \
+		.holder = n##_holder,                                          \
+		.links = n##_links,                                            \
+		.map = n##_map                                                 \
+	}
+#define LOCKING_HOLDERS_RESET(n) locking_holders_reset(&n##_holders)
+
+void locking_holders_reset(struct locking_holders *holders);
+#else
+/* Declaration only, so the generated table is the same either way */
+#define LOCKING_HOLDERS_DEFINE(n, limit) extern int n##_holders_unused
+#define LOCKING_HOLDERS_RESET(n)
+#endif
+
+#ifdef CONFIG_LOCKING_PERSIST
+/* Statistics of one lock, as saved in the previous boot */
+struct locking_counters {
+	locking_id_t id;
+	uint32_t takes;
+	uint32_t gives;
+	uint32_t contended;
+	uint32_t timeouts;
+};
+
+enum locking_event_kind {
+	LOCKING_EVENT_TAKE = 0,
+	LOCKING_EVENT_TAKE_FAILED,
+	LOCKING_EVENT_GIVE,
+	LOCKING_EVENT_HANDOFF
 };
 
+/* A take, give or handoff, kept in no-init RAM */
+struct locking_event {
+	/* k_uptime_get_32() */
+	uint32_t time;
+	struct k_thread *thread;
+	locking_id_t id;
+	uint8_t kind;
+	/* Error code of a failed take or give (clipped to INT8_MIN) */
+	int8_t result;
+};
+#endif
+
 typedef struct locking_table_entry lte_t;
 
+/* The generated table is const, entries of runtime created locks
+ * (CONFIG_LOCKING_DYNAMIC) are filled in by locking_create.
+ */
 struct locking_table_entry {
-	const locking_id_t id;
-	const char *const name;
-	void *const pData;
-	const enum locking_type type;
-	const uint8_t count;
-	const uint8_t limit;
+	locking_id_t id;
+	const char *name;
+	void *pData;
+	enum locking_type type;
+	uint8_t count;
+	uint8_t limit;
 	uint8_t current;
+	/* Highest level the lock can be instrumented at */
+	uint8_t instrument;
+#ifdef CONFIG_LOCKING_STATS
+	struct locking_stats *stats;
+#endif
+#ifdef CONFIG_LOCKING_HOLDERS
+	/* Semaphores only, NULL for other types */
+	struct locking_holders *holders;
+#endif
+#ifdef CONFIG_LOCKING_STRIPED
+	/* Number of lock objects (a power of two, 0 when not striped) and the
+	 * distance between them, pData and stats point at the first.
+	 */
+	uint16_t stripes;
+	uint16_t stride;
+#endif
+};
+
+struct locking_footprint {
+	size_t objects;
+	size_t aligned;
+	size_t padding;
+	/* Flash, names are 0 without CONFIG_LOCKING_STRING_NAME */
+	size_t table;
+	size_t map;
+	size_t names;
+};
+
+/* Cost of the lock table, times are averages in nanoseconds */
+struct locking_bench {
+	locking_index_t locks;
+	locking_id_t max_id;
+	uint32_t init_ns;
+	uint32_t map_ns;
+	uint32_t get_id_ns;
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,44 @@
+/**
+ * @file locking_mgmt.h
+ * @brief mcumgr (SMP) command group for reading lock state
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_MGMT_H__
+#define __LOCKING_MGMT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Command IDs within CONFIG_LOCKING_MGMT_GROUP_ID */
+enum locking_mgmt_id {
+	/* Read a snapshot of the locks with index in [start, start + count).
+	 *
+	 * Request:  { "start": uint (default 0), "count": uint (optional) }
+	 * Response: { "total": uint, "next": uint,
+	 *             "locks": [ { "i": index, "id": id, "t": type,
+	 *                          "c": mutex lock count or semaphore free units,
+	 *                          "w": number of waiting threads,
+	 *                          "o": mutex owner thread address,
+	 *                          "s": [ takes, gives, contended, timeouts ] },
+	 *                        ... ] }
+	 *
+	 * "o" is only present for held mutexes and "s" only when
+	 * CONFIG_LOCKING_STATS is enabled. "next" equals "total" on the last
+	 * page. Unused runtime lock slots (CONFIG_LOCKING_DYNAMIC) follow the
+	 * generated locks with type 0.
+	 */
+	LOCKING_MGMT_ID_SNAPSHOT = 0,
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_MGMT_H__ */
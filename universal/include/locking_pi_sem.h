@@ -0,0 +1,107 @@
+/**
+ * @file locking_pi_sem.h
+ *
+ * @brief Priority inheriting binary semaphore, may be given by a thread (or
+ *        ISR) other than the one that took it
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_PI_SEM_H__
+#define __LOCKING_PI_SEM_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <sys/dlist.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Fields are private, use the functions below or the locking API. */
+struct locking_pi_sem {
+	struct k_spinlock lock;
+	struct k_sem sem;
+	bool held;
+	/* Thread that took the semaphore (NULL if taken in an ISR) */
+	struct k_thread *holder;
+	/* Priority of the holder before it inherited any */
+	int base_prio;
+	/* Threads waiting, the holder runs at the priority of the highest */
+	sys_dlist_t waiters;
+	/* A give from an ISR leaves the holder's priority to be restored by
+	 * the system work queue or the next take. There is at most one, a
+	 * second give needs a take in between.
+	 */
+	struct k_work restore;
+	struct k_thread *restore_thread;
+	int restore_prio;
+	/* Times a holder was raised to the priority of a waiter */
+	uint32_t boosts;
+};
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Initialise a priority inheriting semaphore, free.
+ *
+ * @param pi Semaphore.
+ */
+void locking_pi_sem_init(struct locking_pi_sem *pi);
+
+/**
+ * @brief Free the semaphore and drop any inherited priority (debug use
+ *        only).
+ *
+ * @param pi Semaphore.
+ */
+void locking_pi_sem_reset(struct locking_pi_sem *pi);
+
+/**
+ * @brief Take the semaphore. While waiting, the holder runs at least at the
+ *        priority of the caller.
+ *
+ * @param pi Semaphore.
+ * @param wait_time The time to wait (K_NO_WAIT in an ISR).
+ *
+ * @retval -EBUSY taken and wait_time is K_NO_WAIT, -EAGAIN timed out,
+ *         0 on success.
+ */
+int locking_pi_sem_take(struct locking_pi_sem *pi, k_timeout_t wait_time);
+
+/**
+ * @brief Give the semaphore, from any thread or ISR. The holder drops back
+ *        to its own priority.
+ *
+ * @param pi Semaphore.
+ *
+ * @retval -EALREADY the semaphore is not taken, 0 on success.
+ */
+int locking_pi_sem_give(struct locking_pi_sem *pi);
+
+/**
+ * @brief Make another thread the holder. The caller drops back to its own
+ *        priority and the new holder inherits from the waiters.
+ *
+ * @param pi Semaphore.
+ * @param to New holder.
+ *
+ * @retval -EALREADY the semaphore is not taken, -EPERM the calling thread is
+ *         not the holder, -EBUSY to is waiting for the semaphore,
+ *         0 on success.
+ */
+int locking_pi_sem_handoff(struct locking_pi_sem *pi, struct k_thread *to);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_PI_SEM_H__ */
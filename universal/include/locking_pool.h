@@ -0,0 +1,113 @@
+/**
+ * @file locking_pool.h
+ *
+ * @brief Resource pool lock, a counting semaphore that also hands out the
+ *        index of a free slot
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_POOL_H__
+#define __LOCKING_POOL_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <sys/atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Fields are private, use the functions below or the locking API. */
+struct locking_pool {
+	/* One unit per free slot */
+	struct k_sem sem;
+	/* Bit set for each free slot */
+	atomic_t *map;
+	/* Thread holding each slot (CONFIG_LOCKING_POOL_CHECKS), or NULL */
+	struct k_thread **owner;
+	uint16_t size;
+};
+
+/* Storage of a pool, defined next to the generated lock object */
+#ifdef CONFIG_LOCKING_POOL_CHECKS
+#define LOCKING_POOL_DEFINE(n, size)                                           \
+	static ATOMIC_DEFINE(n##_map, size);                                   \
+	static struct k_thread *n##_owner[size]
+#define LOCKING_POOL_OWNER(n) n##_owner
+#else
+#define LOCKING_POOL_DEFINE(n, size) static ATOMIC_DEFINE(n##_map, size)
+#define LOCKING_POOL_OWNER(n) NULL
+#endif
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Initialise a pool with every slot free.
+ *
+ * @param pool Pool lock.
+ * @param map Bitmap of at least size bits (ATOMIC_DEFINE).
+ * @param owner Array of size entries for slot owner checks, may be NULL.
+ * @param size Number of slots.
+ */
+void locking_pool_init(struct locking_pool *pool, atomic_t *map,
+		       struct k_thread **owner, uint16_t size);
+
+/**
+ * @brief Free every slot (debug use only, slots taken are lost).
+ *
+ * @param pool Pool lock.
+ */
+void locking_pool_reset(struct locking_pool *pool);
+
+/**
+ * @brief Wait for a free slot and claim it.
+ *
+ * @param pool Pool lock.
+ * @param wait_time The time to wait for a slot.
+ * @param slot Set to the index of the slot.
+ *
+ * @retval -EBUSY no slot free and wait_time is K_NO_WAIT, -EAGAIN timed out,
+ *         0 on success.
+ */
+int locking_pool_take(struct locking_pool *pool, k_timeout_t wait_time,
+		      uint16_t *slot);
+
+/**
+ * @brief Release a slot.
+ *
+ * @param pool Pool lock.
+ * @param slot Index returned by locking_pool_take().
+ *
+ * @retval -EINVAL slot out of range, -EALREADY slot is already free (double
+ *         free), -EPERM slot held by another thread (only detected with
+ *         CONFIG_LOCKING_POOL_CHECKS), 0 on success.
+ */
+int locking_pool_give(struct locking_pool *pool, uint16_t slot);
+
+/**
+ * @brief Check whether a slot is in use.
+ *
+ * @param pool Pool lock.
+ * @param slot Index of the slot.
+ * @param owner Set to the thread holding the slot (NULL without
+ *              CONFIG_LOCKING_POOL_CHECKS), may be NULL.
+ *
+ * @retval true if the slot is taken.
+ */
+bool locking_pool_slot_used(struct locking_pool *pool, uint16_t slot,
+			    struct k_thread **owner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_POOL_H__ */
@@ -0,0 +1,166 @@
+/**
+ * @file locking_private.h
+ *
+ * @brief Functions shared between the locking module source files
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_PRIVATE_H__
+#define __LOCKING_PRIVATE_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#include "locking_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Take a lock table entry (locking_take without the ID lookup).
+ *
+ * @param entry Lock table entry.
+ * @param id ID the entry was mapped from, -EINVAL once it is destroyed.
+ * @param wait_time The time to wait to take the lock.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_take_entry(const lte_t *const entry, locking_id_t id,
+		       k_timeout_t wait_time);
+
+/**
+ * @brief Give a lock table entry (locking_give without the ID lookup).
+ *
+ * @param entry Lock table entry.
+ * @param id ID the entry was mapped from, -EINVAL once it is destroyed.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int locking_give_entry(const lte_t *const entry, locking_id_t id);
+
+#ifdef CONFIG_LOCKING_STATS
+/**
+ * @brief Sum the statistics of a lock over all of its stripes.
+ *
+ * @param entry Lock table entry.
+ * @param total Destination.
+ */
+void locking_stats_total(const lte_t *const entry, struct locking_stats *total);
+#endif
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+/**
+ * @brief Set the runtime instrumentation level of a lock to its table level.
+ *
+ * @param entry Lock table entry.
+ */
+void locking_instrument_reset(const lte_t *const entry);
+#endif
+
+#ifdef CONFIG_LOCKING_PERSIST
+/**
+ * @brief Keep the no-init region of the previous boot (if valid) and start
+ *        a new one.
+ */
+void locking_persist_init(void);
+
+/**
+ * @brief Record a take or give in the no-init event ring.
+ *
+ * @param entry Lock table entry.
+ * @param kind What happened.
+ * @param r Result of the take or give.
+ */
+void locking_persist_event(const lte_t *const entry,
+			   enum locking_event_kind kind, int r);
+#endif
+
+#ifdef CONFIG_LOCKING_BENCH
+/**
+ * @brief Record how long locking_table_initialise() took at boot.
+ *
+ * @param cycles Hardware cycles.
+ */
+void locking_bench_initialised(uint32_t cycles);
+#endif
+
+#ifdef CONFIG_LOCKING_BLAME
+/**
+ * @brief Add a take by the calling thread to its row of the blame matrix.
+ *
+ * @param entry Lock table entry.
+ * @param r Result of the take.
+ * @param contended The lock was not free.
+ * @param blocked Cycles spent waiting for the lock.
+ */
+void locking_blame_add(const lte_t *const entry, int r, bool contended,
+		       uint32_t blocked);
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+/**
+ * @brief Record the calling thread as the holder of a semaphore unit.
+ *
+ * @param entry Lock table entry (ignored if not a semaphore).
+ * @param call_site Return address of the take.
+ */
+void locking_holders_add(const lte_t *const entry, void *call_site);
+
+/**
+ * @brief Release the holder record of a semaphore unit that is being given.
+ *
+ * @param entry Lock table entry (ignored if not a semaphore).
+ */
+void locking_holders_remove(const lte_t *const entry);
+
+#ifdef CONFIG_LOCKING_HANDOFF
+/**
+ * @brief Pass the calling thread's most recent holder record of a semaphore
+ *        to another thread, the time it was taken is kept.
+ *
+ * @param entry Lock table entry (ignored if not a semaphore).
+ * @param to New holder.
+ * @param call_site Return address of the handoff.
+ *
+ * @retval -ENOENT the calling thread holds no unit, -ENOTSUP holders are
+ *         not tracked for the lock, 0 on success.
+ */
+int locking_holders_handoff(const lte_t *const entry, struct k_thread *to,
+			    void *call_site);
+#endif
+#endif
+
+#ifdef CONFIG_LOCKING_ASYNC
+/**
+ * @brief Called after a lock has been given, grants the next queued
+ *        asynchronous request (if any).
+ *
+ * @param entry Lock table entry.
+ */
+void locking_async_given(const lte_t *const entry);
+
+/**
+ * @brief Check for queued asynchronous requests.
+ *
+ * @param entry Lock table entry.
+ *
+ * @retval true if requests are waiting for the lock.
+ */
+bool locking_async_pending(const lte_t *const entry);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_PRIVATE_H__ */
@@ -0,0 +1,90 @@
+/**
+ * @file locking_rate.h
+ *
+ * @brief Rate lock, a token bucket refilled from the elapsed time
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_RATE_H__
+#define __LOCKING_RATE_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <sys/atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Fields are private, use the functions below or the locking API. Times are
+ * in units of 1/rate ticks so that one token is exactly
+ * CONFIG_SYS_CLOCK_TICKS_PER_SEC units.
+ */
+struct locking_rate {
+	struct k_spinlock lock;
+	/* When the bucket is full again (theoretical arrival time) */
+	uint64_t tat;
+	/* Time the bucket can run ahead of now, burst - 1 tokens */
+	uint64_t tolerance;
+	uint32_t rate;
+	uint8_t burst;
+	/* Threads sleeping until their token is due */
+	atomic_t waiting;
+};
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Initialise a rate lock with a full bucket.
+ *
+ * @param rate Rate lock.
+ * @param per_sec Tokens added per second.
+ * @param burst Size of the bucket, the most tokens taken without waiting.
+ */
+void locking_rate_init(struct locking_rate *rate, uint32_t per_sec,
+		       uint8_t burst);
+
+/**
+ * @brief Fill the bucket (debug use only).
+ *
+ * @param rate Rate lock.
+ */
+void locking_rate_reset(struct locking_rate *rate);
+
+/**
+ * @brief Take a token. When the bucket is empty the token that is due next
+ *        is reserved and the caller sleeps until it is due, so waiters are
+ *        admitted in arrival order at the configured rate.
+ *
+ * @param rate Rate lock.
+ * @param wait_time The time to wait for a token, nothing is reserved if the
+ *        token is not due within it.
+ *
+ * @retval -EBUSY no token and wait_time is K_NO_WAIT, -EAGAIN the next
+ *         token is not due in time, 0 on success.
+ */
+int locking_rate_take(struct locking_rate *rate, k_timeout_t wait_time);
+
+/**
+ * @brief Get the number of tokens that can be taken without waiting.
+ *
+ * @param rate Rate lock.
+ *
+ * @retval Tokens in the bucket, 0 to burst.
+ */
+uint8_t locking_rate_tokens(struct locking_rate *rate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_RATE_H__ */
@@ -23,6 +23,12 @@
 extern "C" {
 #endif
 
+/******************************************************************************/
+/* Global Data Definitions                                                    */
+/******************************************************************************/
+/* RAM used by the generated lock objects, flash used by the table */
+extern const struct locking_footprint LOCKING_FOOTPRINT;
+
 /******************************************************************************/
 /* Global Function Prototypes                                                 */
 /******************************************************************************/
@@ -53,6 +59,60 @@ const struct locking_table_entry *const locking_map(locking_id_t id);
 locking_index_t locking_table_index(
 			const struct locking_table_entry *const entry);
 
+/**
+ * @brief Map index to table entry
+ *
+ * @param index Index of lock element.
+ * @return Table entry, NULL if index is out of range. Unused entries of
+ *         runtime created locks have type LOCKING_TYPE_UNKNOWN.
+ */
+const struct locking_table_entry *locking_entry(locking_index_t index);
+
+#ifdef CONFIG_LOCKING_DYNAMIC
+/**
+ * @brief Map an ID above LOCKING_TABLE_MAX_ID to a runtime created lock
+ *
+ * @param id ID of lock element.
+ * @return Table entry, NULL if the ID is not (or no longer) in use.
+ */
+const struct locking_table_entry *const locking_dynamic_map(locking_id_t id);
+
+/**
+ * @brief Pin a runtime created lock so that it can't be destroyed while its
+ * object is in use
+ *
+ * @param entry Mapped entry (generated entries are accepted and never pinned).
+ * @param id ID the entry was mapped from.
+ * @retval true Pinned, release with locking_dynamic_put().
+ * @retval false The lock was destroyed, or its slot now holds another lock.
+ */
+bool locking_dynamic_get(const struct locking_table_entry *entry,
+			 locking_id_t id);
+
+/**
+ * @brief Release a pin taken by locking_dynamic_get()
+ *
+ * @param entry Pinned entry.
+ */
+void locking_dynamic_put(const struct locking_table_entry *entry);
+
+/**
+ * @brief Map index (relative to LOCKING_TABLE_SIZE) to runtime lock entry
+ *
+ * @param index Dynamic index.
+ * @return Table entry, NULL if index is out of range.
+ */
+const struct locking_table_entry *locking_dynamic_entry(locking_index_t index);
+
+/**
+ * @brief Calculate index of a runtime created lock entry
+ *
+ * @param entry
+ * @return locking_index_t
+ */
+locking_index_t locking_dynamic_index(const struct locking_table_entry *entry);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
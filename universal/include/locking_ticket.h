@@ -0,0 +1,111 @@
+/**
+ * @file locking_ticket.h
+ *
+ * @brief FIFO (ticket) lock, granted to waiters in arrival order
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_TICKET_H__
+#define __LOCKING_TICKET_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <sys/dlist.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Starvation metrics, wait times are in hardware cycles */
+struct locking_ticket_metrics {
+	/* Most times a single waiter was overtaken (bypass policy only) */
+	uint32_t max_bypass;
+	/* Number of takes that had to wait */
+	uint32_t waits;
+	uint64_t min_wait;
+	uint64_t max_wait;
+	uint64_t total_wait;
+};
+
+/* Fields are private, use the functions below or the locking API. */
+struct locking_ticket {
+	struct k_spinlock lock;
+	/* Waiters in grant order */
+	sys_dlist_t queue;
+	struct k_thread *owner;
+	/* How many times a waiter may be overtaken by a higher priority
+	 * thread, 0 for strict arrival order.
+	 */
+	uint8_t bypass;
+	struct locking_ticket_metrics metrics;
+};
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Initialise a ticket lock.
+ *
+ * @param ticket Ticket lock.
+ * @param bypass How many times a waiter may be overtaken by higher priority
+ *               threads that arrive after it, 0 grants in arrival order.
+ */
+void locking_ticket_init(struct locking_ticket *ticket, uint8_t bypass);
+
+/**
+ * @brief Take a ticket lock. The lock is handed directly to the waiter at
+ *        the head of the queue when it is given, so a thread that gives and
+ *        immediately takes again goes to the back of the queue.
+ *
+ * @param ticket Ticket lock.
+ * @param wait_time The time to wait to take the lock.
+ *
+ * @retval -EBUSY not available and wait_time is K_NO_WAIT,
+ *         -EDEADLK already held by the calling thread (not recursive),
+ *         -EAGAIN timed out, 0 on success.
+ */
+int locking_ticket_take(struct locking_ticket *ticket, k_timeout_t wait_time);
+
+/**
+ * @brief Give a ticket lock to the next waiter (or release it).
+ *
+ * @param ticket Ticket lock.
+ *
+ * @retval -EPERM the calling thread does not hold the lock, 0 on success.
+ */
+int locking_ticket_give(struct locking_ticket *ticket);
+
+/**
+ * @brief Make another thread the owner of a held ticket lock, the queue is
+ *        left as it is.
+ *
+ * @param ticket Ticket lock.
+ * @param to New owner.
+ *
+ * @retval -EPERM the calling thread does not hold the lock,
+ *         -EBUSY to is waiting for the lock, 0 on success.
+ */
+int locking_ticket_handoff(struct locking_ticket *ticket, struct k_thread *to);
+
+/**
+ * @brief Copy the starvation metrics of a ticket lock.
+ *
+ * @param ticket Ticket lock.
+ * @param metrics Destination.
+ */
+void locking_ticket_metrics_get(struct locking_ticket *ticket,
+				struct locking_ticket_metrics *metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_TICKET_H__ */
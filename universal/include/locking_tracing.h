@@ -0,0 +1,102 @@
+/**
+ * @file locking_tracing.h
+ *
+ * @brief Tracing subsystem (CTF) events for lock operations
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LOCKING_TRACING_H__
+#define __LOCKING_TRACING_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <zephyr/types.h>
+
+#include "locking_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+#ifdef CONFIG_LOCKING_TRACING
+/* Must stay in the order of CTF_EVENTS in locking_generator.py */
+enum locking_ctf_event {
+	LOCKING_CTF_TAKE_ENTER = CONFIG_LOCKING_TRACING_EVENT_ID,
+	LOCKING_CTF_TAKE_EXIT,
+	LOCKING_CTF_GIVE,
+	LOCKING_CTF_HANDOFF
+};
+#endif
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+#ifdef CONFIG_LOCKING_TRACING
+/**
+ * @brief Emit a trace event before a take (which may block).
+ *
+ * @param entry Lock table entry.
+ */
+void locking_trace_take_enter(const lte_t *const entry);
+
+/**
+ * @brief Emit a trace event with the result of a take.
+ *
+ * @param entry Lock table entry.
+ * @param r Result of the take.
+ */
+void locking_trace_take_exit(const lte_t *const entry, int r);
+
+/**
+ * @brief Emit a trace event with the result of a give.
+ *
+ * @param entry Lock table entry.
+ * @param r Result of the give.
+ */
+void locking_trace_give(const lte_t *const entry, int r);
+
+/**
+ * @brief Emit a trace event when the caller hands a lock to another thread.
+ *
+ * @param entry Lock table entry.
+ * @param to New owner.
+ */
+void locking_trace_handoff(const lte_t *const entry, struct k_thread *to);
+#else
+static inline void locking_trace_take_enter(const lte_t *const entry)
+{
+	ARG_UNUSED(entry);
+}
+
+static inline void locking_trace_take_exit(const lte_t *const entry, int r)
+{
+	ARG_UNUSED(entry);
+	ARG_UNUSED(r);
+}
+
+static inline void locking_trace_give(const lte_t *const entry, int r)
+{
+	ARG_UNUSED(entry);
+	ARG_UNUSED(r);
+}
+
+static inline void locking_trace_handoff(const lte_t *const entry,
+					 struct k_thread *to)
+{
+	ARG_UNUSED(entry);
+	ARG_UNUSED(to);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOCKING_TRACING_H__ */
@@ -24,6 +24,8 @@ LOG_MODULE_REGISTER(locking, CONFIG_LOCKING_LOG_LEVEL);
 
 #include "locking_table.h"
 #include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking_tracing.h"
 #include "locking.h"
 
 /******************************************************************************/
@@ -34,6 +36,18 @@ LOG_MODULE_REGISTER(locking, CONFIG_LOCKING_LOG_LEVEL);
 #define LOCKING_ENTRY_DECL(x)                                                  \
 	const struct locking_table_entry *const entry = locking_map(x);
 
+/* Runtime created locks are pinned while their object is in use so that
+ * they can't be destroyed under the caller. The pin fails unless the entry
+ * still has the ID it was mapped from.
+ */
+#ifdef CONFIG_LOCKING_DYNAMIC
+#define PIN(e, id) locking_dynamic_get(e, id)
+#define UNPIN(e) locking_dynamic_put(e)
+#else
+#define PIN(e, id) true
+#define UNPIN(e)
+#endif
+
 static const char EMPTY_STRING[] = "";
 
 #if defined(CONFIG_THREAD_MAX_NAME_LEN) && CONFIG_THREAD_MAX_NAME_LEN > 10
@@ -42,10 +56,72 @@ static const char EMPTY_STRING[] = "";
 #define OUTPUT_THREAD_NAME_SIZE 11
 #endif
 
+/* Number of lock states captured per pass when printing the whole table */
+#define SHOW_ALL_CHUNK 8
+
+BUILD_ASSERT(IS_ENABLED(CONFIG_LOCKING_TICKET) ||
+		     !(LOCKING_TABLE_TYPES & BIT(LOCKING_TYPE_TICKET)),
+	     "Lock table uses ticket locks, enable CONFIG_LOCKING_TICKET");
+BUILD_ASSERT(IS_ENABLED(CONFIG_LOCKING_COMBINING) ||
+		     !(LOCKING_TABLE_TYPES & BIT(LOCKING_TYPE_COMBINING)),
+	     "Lock table uses combining locks, enable CONFIG_LOCKING_COMBINING");
+BUILD_ASSERT(IS_ENABLED(CONFIG_LOCKING_POOL) ||
+		     !(LOCKING_TABLE_TYPES & BIT(LOCKING_TYPE_POOL)),
+	     "Lock table uses pool locks, enable CONFIG_LOCKING_POOL");
+BUILD_ASSERT(IS_ENABLED(CONFIG_LOCKING_BARRIER) ||
+		     !(LOCKING_TABLE_TYPES &
+		       (BIT(LOCKING_TYPE_BARRIER) | BIT(LOCKING_TYPE_LATCH))),
+	     "Lock table uses barrier or latch locks, "
+	     "enable CONFIG_LOCKING_BARRIER");
+BUILD_ASSERT(IS_ENABLED(CONFIG_LOCKING_PI_SEMAPHORE) ||
+		     !(LOCKING_TABLE_TYPES & BIT(LOCKING_TYPE_PI_SEMAPHORE)),
+	     "Lock table uses pi_semaphore locks, "
+	     "enable CONFIG_LOCKING_PI_SEMAPHORE");
+BUILD_ASSERT(IS_ENABLED(CONFIG_LOCKING_RATE) ||
+		     !(LOCKING_TABLE_TYPES & BIT(LOCKING_TYPE_RATE)),
+	     "Lock table uses rate locks, enable CONFIG_LOCKING_RATE");
+BUILD_ASSERT(IS_ENABLED(CONFIG_LOCKING_STRIPED) || !LOCKING_TABLE_STRIPED,
+	     "Lock table uses x-instances, enable CONFIG_LOCKING_STRIPED");
+
+/* Lock objects of a striped entry are stride bytes apart, stats included */
+#ifdef CONFIG_LOCKING_STRIPED
+#define STRIPES(e) MAX((e)->stripes, 1)
+#define STRIPE(e, p, i) ((void *)((uint8_t *)(p) + ((size_t)(i) * (e)->stride)))
+#else
+#define STRIPES(e) 1
+#define STRIPE(e, p, i) ((void *)(p))
+#endif
+
+/* Runtime instrumentation level of a lock, without CONFIG_LOCKING_INSTRUMENT
+ * every lock is fully instrumented and the checks fold away.
+ */
+#ifdef CONFIG_LOCKING_INSTRUMENT
+#define LEVEL(e) levels[locking_table_index(e)]
+#else
+#define LEVEL(e) LOCKING_INSTRUMENT_TRACE
+#endif
+
 /******************************************************************************/
-/* Global Data Definitions                                                    */
+/* Local Data Definitions                                                     */
 /******************************************************************************/
-extern const struct locking_table_entry LOCKING_TABLE[LOCKING_TABLE_SIZE];
+static struct k_spinlock snapshot_lock;
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+/* Up to the level of the table entry (x-instrument) */
+static uint8_t levels[LOCKING_INDEX_COUNT];
+#endif
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+/* Return address of the outermost take of the current owner. There is one
+ * per lock, so striped locks (whose stripes have separate owners) are not
+ * recorded, see owned_once().
+ */
+static void *call_sites[LOCKING_INDEX_COUNT];
+#if CONFIG_LOCKING_LONG_HOLD_MS > 0
+/* k_uptime_get_32() at that take */
+static uint32_t taken_at[LOCKING_INDEX_COUNT];
+#endif
+#endif
 
 /******************************************************************************/
 /* Local Function Prototypes                                                  */
@@ -54,12 +130,56 @@ extern const struct locking_table_entry LOCKING_TABLE[LOCKING_TABLE_SIZE];
 static int show(const lte_t *const entry);
 #endif
 
+static void capture_state(const lte_t *const entry,
+			  struct locking_state *state);
+static void capture_object(const lte_t *const entry, void *object,
+			   struct locking_state *state);
+static uint16_t wait_q_count(_wait_q_t *wait_q);
+
 #if defined(CONFIG_LOCKING_VERBOSE_DEBUGGING) || defined(CONFIG_LOCKING_SHELL)
 static const char *plural(uint8_t input);
 static void get_mutex_thread_name(struct k_thread *mutex_owner_thread,
 				  uint8_t *buffer, uint8_t buffer_size);
 #endif
 
+static int take_object(const lte_t *const entry, uint16_t stripe,
+		       k_timeout_t wait_time);
+static int give_object(const lte_t *const entry, uint16_t stripe);
+static int take_entry(const lte_t *const entry, locking_id_t id,
+		      uint16_t stripe, k_timeout_t wait_time, void *call_site);
+static void taking(const lte_t *const entry);
+static void taken(const lte_t *const entry, uint16_t stripe, int r,
+		  bool contended, void *call_site);
+static int give_entry(const lte_t *const entry, locking_id_t id,
+		      uint16_t stripe, void *call_site);
+static void given(const lte_t *const entry, uint16_t stripe, int r);
+#ifdef CONFIG_LOCKING_HANDOFF
+static int handoff_object(const lte_t *const entry, uint16_t stripe,
+			  struct k_thread *to, void *call_site);
+static void handed_off(const lte_t *const entry, uint16_t stripe,
+		       struct k_thread *to, void *call_site);
+#endif
+#ifdef CONFIG_LOCKING_STATS
+static struct locking_stats *stripe_stats(const lte_t *const entry,
+					  uint16_t stripe);
+static int take_counted(const lte_t *const entry, uint16_t stripe,
+			k_timeout_t wait_time, bool *contended);
+#endif
+#if defined(CONFIG_LOCKING_INSTRUMENT) || defined(CONFIG_LOCKING_CALL_SITES)
+static bool exclusive(const lte_t *const entry, uint16_t stripe);
+#endif
+#ifdef CONFIG_LOCKING_INSTRUMENT
+static void update_max(atomic_t *max, uint32_t value);
+static uint32_t depth(const lte_t *const entry, uint16_t stripe);
+#endif
+#ifdef CONFIG_LOCKING_CALL_SITES
+static void owner_giving(const lte_t *const entry, void *call_site);
+static bool owned_once(const lte_t *const entry);
+#endif
+#ifdef CONFIG_LOCKING_STRIPED
+static uint16_t key_stripe(const lte_t *const entry, uint32_t key);
+#endif
+
 static int locking_init(const struct device *device);
 
 extern void locking_table_initialise(void);
@@ -101,223 +221,1725 @@ const char *locking_get_name(locking_id_t id)
 	return s;
 }
 
-#ifdef CONFIG_LOCKING_SHELL
-
-locking_id_t locking_get_id(const char *name)
+#ifdef CONFIG_LOCKING_TAKE_ANY
+int locking_take_any(const locking_id_t *ids, size_t n, k_timeout_t timeout,
+		     locking_id_t *got)
 {
-#ifdef CONFIG_LOCKING_STRING_NAME
-	locking_index_t i;
+	struct k_poll_event events[CONFIG_LOCKING_TAKE_ANY_MAX];
+	const lte_t *entries[CONFIG_LOCKING_TAKE_ANY_MAX];
+	int64_t end = sys_clock_timeout_end_calc(timeout);
+	int64_t remaining;
+	void *call_site = __builtin_return_address(0);
+	bool waited = false;
+	size_t i;
+	int r;
 
-	for (i = 0; i < LOCKING_TABLE_SIZE; i++) {
-		if (strcmp(name, LOCKING_TABLE[i].name) == 0) {
-			return LOCKING_TABLE[i].id;
+	if (ids == NULL || got == NULL || n == 0 || n > ARRAY_SIZE(events)) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < n; i++) {
+		entries[i] = locking_map(ids[i]);
+		if (entries[i] == NULL || !PIN(entries[i], ids[i])) {
+			r = -EINVAL;
+		} else if (entries[i]->type != LOCKING_TYPE_SEMAPHORE) {
+			UNPIN(entries[i]);
+			r = -ENOTSUP;
+		} else {
+			r = 0;
+		}
+
+		if (r != 0) {
+			while (i-- > 0) {
+				UNPIN(entries[i]);
+			}
+			return r;
 		}
+
+		k_poll_event_init(&events[i], K_POLL_TYPE_SEM_AVAILABLE,
+				  K_POLL_MODE_NOTIFY_ONLY, entries[i]->pData);
 	}
-#endif
 
-	return LOCKING_INVALID_ID;
+	/* The caller waits on every lock of the set, the take that ends the
+	 * wait is only accounted to the lock that was taken.
+	 */
+	for (i = 0; i < n; i++) {
+		taking(entries[i]);
+	}
+
+	while (true) {
+		/* Only one unit is taken, the others are left untouched */
+		for (i = 0; i < n; i++) {
+			if (k_sem_take(entries[i]->pData, K_NO_WAIT) == 0) {
+				break;
+			}
+			events[i].state = K_POLL_STATE_NOT_READY;
+		}
+
+		if (i < n) {
+			taken(entries[i], 0, 0, waited, call_site);
+			*got = ids[i];
+			r = 0;
+			break;
+		} else if (K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+			r = -EBUSY;
+			break;
+		} else if (K_TIMEOUT_EQ(timeout, K_FOREVER)) {
+			r = k_poll(events, n, K_FOREVER);
+		} else {
+			remaining = end - k_uptime_ticks();
+			if (remaining <= 0) {
+				r = -EAGAIN;
+				break;
+			}
+			r = k_poll(events, n, K_TICKS(remaining));
+		}
+
+		/* A unit can be taken by another thread between the wake up
+		 * and the take, in which case the wait is repeated.
+		 */
+		if (r != 0 && r != -EINTR) {
+			break;
+		}
+		waited = true;
+	}
+
+	for (i = 0; i < n; i++) {
+		/* None was taken, every lock of the set failed */
+		if (r != 0) {
+			taken(entries[i], 0, r, waited, call_site);
+		}
+		UNPIN(entries[i]);
+	}
+
+	return r;
 }
+#endif /* CONFIG_LOCKING_TAKE_ANY */
 
-static int shell_show(const struct shell *shell, const lte_t *const entry)
+#ifdef CONFIG_LOCKING_COMBINING
+int locking_execute(locking_id_t id, locking_combining_fn_t fn, void *arg)
 {
+	bool contended = false;
 	int r;
-	uint8_t thread_name_buffer[OUTPUT_THREAD_NAME_SIZE];
-	struct k_mutex *tmp_mutex;
-	thread_name_buffer[0] = 0;
+	LOCKING_ENTRY_DECL(id);
 
-	switch (entry->type) {
-	case LOCKING_TYPE_MUTEX:
-		tmp_mutex = (struct k_mutex*)entry->pData;
-		get_mutex_thread_name(tmp_mutex->owner,
-				      thread_name_buffer,
-				      sizeof(thread_name_buffer));
+	if (k_is_in_isr()) {
+		/* The caller may have to sleep, and the interrupted thread
+		 * would be taken for the holder.
+		 */
+		return -EWOULDBLOCK;
+	} else if (entry == NULL || fn == NULL || !PIN(entry, id)) {
+		return -EINVAL;
+	} else if (entry->type != LOCKING_TYPE_COMBINING) {
+		UNPIN(entry);
+		return -ENOTSUP;
+	}
 
-		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
-			    ": mutex (%d lock%s held%s%s)",
-			    entry->id, entry->name, tmp_mutex->lock_count,
-			    plural(tmp_mutex->lock_count),
-			    (tmp_mutex->lock_count == 0 ? "" : " by "),
-			    thread_name_buffer
-			   );
-		break;
+	/* Traced and counted as a take and give of the calling thread, even
+	 * when fn runs in the holder.
+	 */
+	taking(entry);
+	r = locking_combining_execute(entry->pData, fn, arg, &contended);
+	taken(entry, 0, r, contended, __builtin_return_address(0));
 
-	case LOCKING_TYPE_SEMAPHORE:
-		r = k_sem_count_get(entry->pData);
-		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
-			    ": semaphore (%d of %d lock%s free)",
-			    entry->id, entry->name, r, entry->limit,
-			    plural(entry->limit));
-		break;
+	if (r == 0) {
+		given(entry, 0, r);
+	}
+	UNPIN(entry);
 
-	default:
-		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
-			    ": unknown type %d", entry->id, entry->name,
-			    entry->type);
-		break;
+	return r;
+}
+#endif /* CONFIG_LOCKING_COMBINING */
+
+#ifdef CONFIG_LOCKING_POOL
+int locking_take_slot(locking_id_t id, k_timeout_t wait_time, uint16_t *slot)
+{
+	bool contended = false;
+	int r;
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry == NULL || slot == NULL) {
+		return -EINVAL;
+	} else if (entry->type != LOCKING_TYPE_POOL) {
+		return -ENOTSUP;
 	}
 
-	return 0;
+	taking(entry);
+
+#ifdef CONFIG_LOCKING_STATS
+	if (LEVEL(entry) >= LOCKING_INSTRUMENT_COUNTERS) {
+		r = locking_pool_take(entry->pData, K_NO_WAIT, slot);
+		if (r != 0 && !K_TIMEOUT_EQ(wait_time, K_NO_WAIT)) {
+			contended = true;
+			r = locking_pool_take(entry->pData, wait_time, slot);
+		}
+	} else {
+		r = locking_pool_take(entry->pData, wait_time, slot);
+	}
+#else
+	r = locking_pool_take(entry->pData, wait_time, slot);
+#endif
+
+	taken(entry, 0, r, contended, __builtin_return_address(0));
+
+	return r;
 }
 
-int locking_show(const struct shell *shell, locking_id_t id)
+int locking_give_slot(locking_id_t id, uint16_t slot)
 {
-	int r = -EINVAL;
+	int r;
 	LOCKING_ENTRY_DECL(id);
 
-	if (entry != NULL) {
-		r = shell_show(shell, entry);
+	if (entry == NULL) {
+		return -EINVAL;
+	} else if (entry->type != LOCKING_TYPE_POOL) {
+		return -ENOTSUP;
 	}
 
+	r = locking_pool_give(entry->pData, slot);
+
+	given(entry, 0, r);
+
 	return r;
 }
+#endif /* CONFIG_LOCKING_POOL */
 
-int locking_show_all(const struct shell *shell)
+#ifdef CONFIG_LOCKING_BARRIER
+int locking_barrier_wait(locking_id_t id, k_timeout_t timeout)
 {
-	locking_index_t i;
+	LOCKING_ENTRY_DECL(id);
 
-	for (i = 0; i < LOCKING_TABLE_SIZE; i++) {
-		(void)shell_show(shell, &LOCKING_TABLE[i]);
+	if (entry == NULL) {
+		return -EINVAL;
+	} else if (entry->type != LOCKING_TYPE_BARRIER) {
+		return -ENOTSUP;
 	}
 
-	return 0;
+	return locking_barrier_wait_object(entry->pData, timeout);
 }
 
-#endif /* CONFIG_LOCKING_SHELL */
+int locking_latch_countdown(locking_id_t id)
+{
+	LOCKING_ENTRY_DECL(id);
 
-/******************************************************************************/
-/* Local Function Definitions                                                 */
-/******************************************************************************/
-#ifdef CONFIG_LOCKING_VERBOSE_DEBUGGING
-static int show(const lte_t *const entry)
+	if (entry == NULL) {
+		return -EINVAL;
+	} else if (entry->type != LOCKING_TYPE_LATCH) {
+		return -ENOTSUP;
+	}
+
+	return locking_latch_countdown_object(entry->pData);
+}
+
+int locking_latch_wait(locking_id_t id, k_timeout_t timeout)
 {
-	int r;
-	uint8_t thread_name_buffer[OUTPUT_THREAD_NAME_SIZE];
-	struct k_mutex *tmp_mutex;
-	thread_name_buffer[0] = 0;
+	LOCKING_ENTRY_DECL(id);
 
-	switch (entry->type) {
-	case LOCKING_TYPE_MUTEX:
-		tmp_mutex = (struct k_mutex*)entry->pData;
-		get_mutex_thread_name(tmp_mutex->owner,
-				      thread_name_buffer,
-				      sizeof(thread_name_buffer));
+	if (entry == NULL) {
+		return -EINVAL;
+	} else if (entry->type != LOCKING_TYPE_LATCH) {
+		return -ENOTSUP;
+	}
 
-		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": mutex (%d lock%s held%s%s)",
-			 entry->id, entry->name, tmp_mutex->lock_count,
-			 plural(tmp_mutex->lock_count),
-			 (tmp_mutex->lock_count == 0 ? "" : " by "),
-			 thread_name_buffer
-			);
-		break;
+	return locking_latch_wait_object(entry->pData, timeout);
+}
+#endif /* CONFIG_LOCKING_BARRIER */
 
-	case LOCKING_TYPE_SEMAPHORE:
-		r = k_sem_count_get(entry->pData);
-		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT
-			 ": semaphore (%d of %d lock%s free)",
-			 entry->id, entry->name, r, entry->limit,
-			 plural(entry->limit));
-		break;
+#ifdef CONFIG_LOCKING_STRIPED
+uint16_t locking_get_stripes(locking_id_t id)
+{
+	LOCKING_ENTRY_DECL(id);
 
-	default:
-		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": unknown type %d",
-			 entry->id, entry->name, entry->type);
-		break;
+	return (entry != NULL) ? STRIPES(entry) : 0;
+}
+
+int locking_take_idx(locking_id_t id, uint16_t i, k_timeout_t wait_time)
+{
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry == NULL || i >= STRIPES(entry)) {
+		return -EINVAL;
 	}
 
-	return 0;
+	return take_entry(entry, id, i, wait_time,
+			  __builtin_return_address(0));
 }
-#endif
 
-#if defined(CONFIG_LOCKING_VERBOSE_DEBUGGING) || defined(CONFIG_LOCKING_SHELL)
-static const char *plural(uint8_t input)
+int locking_give_idx(locking_id_t id, uint16_t i)
 {
-	if (input == 1) {
-		return EMPTY_STRING;
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry == NULL || i >= STRIPES(entry)) {
+		return -EINVAL;
 	}
 
-	return "s";
+	return give_entry(entry, id, i, __builtin_return_address(0));
 }
 
-#ifdef CONFIG_THREAD_NAME
-static void get_mutex_thread_name(struct k_thread *mutex_owner_thread,
-				  uint8_t *buffer, uint8_t buffer_size)
+int locking_take_key(locking_id_t id, uint32_t key, k_timeout_t wait_time)
 {
-	if (mutex_owner_thread == NULL) {
-		buffer[0] = 0;
-		return;
-	} else if (mutex_owner_thread->name == NULL) {
-		snprintk(buffer, buffer_size, "%p", mutex_owner_thread);
-		return;
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry == NULL) {
+		return -EINVAL;
 	}
 
-	strncpy(buffer, mutex_owner_thread->name, buffer_size);
-	buffer[(buffer_size - 1)] = 0;
+	return take_entry(entry, id, key_stripe(entry, key), wait_time,
+			  __builtin_return_address(0));
 }
-#else
-static void get_mutex_thread_name(struct k_thread *mutex_owner_thread,
-				  uint8_t *buffer, uint8_t buffer_size)
+
+int locking_give_key(locking_id_t id, uint32_t key)
 {
-	if (mutex_owner_thread == NULL) {
-		buffer[0] = 0;
-		return;
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry == NULL) {
+		return -EINVAL;
 	}
 
-	snprintk(buffer, buffer_size, "%p", mutex_owner_thread);
+	return give_entry(entry, id, key_stripe(entry, key),
+			  __builtin_return_address(0));
 }
-#endif
+#endif /* CONFIG_LOCKING_STRIPED */
 
-#endif
+#ifdef CONFIG_LOCKING_INSTRUMENT
+int locking_set_instrument(locking_id_t id, enum locking_instrument level)
+{
+	LOCKING_ENTRY_DECL(id);
 
-int locking_take(locking_id_t id, k_timeout_t wait_time)
+	if (entry == NULL) {
+		return -EINVAL;
+	} else if (level > entry->instrument) {
+		return -ENOTSUP;
+	}
+
+	levels[locking_table_index(entry)] = level;
+
+	return 0;
+}
+
+int locking_get_instrument(locking_id_t id, enum locking_instrument *level,
+			   enum locking_instrument *max)
 {
-	int r = -EINVAL;
 	LOCKING_ENTRY_DECL(id);
 
-	if (entry != NULL) {
-		if (entry->type == LOCKING_TYPE_MUTEX) {
-			r = k_mutex_lock(entry->pData, wait_time);
-		} else if (entry->type == LOCKING_TYPE_SEMAPHORE) {
-			r = k_sem_take(entry->pData, wait_time);
-		}
+	if (entry == NULL) {
+		return -EINVAL;
+	}
 
-#ifdef CONFIG_LOCKING_VERBOSE_DEBUGGING
-		show(entry);
-#endif
+	if (level != NULL) {
+		*level = LEVEL(entry);
+	}
+	if (max != NULL) {
+		*max = entry->instrument;
 	}
 
-	return r;
+	return 0;
 }
 
-int locking_give(locking_id_t id)
+void locking_instrument_reset(const lte_t *const entry)
+{
+	levels[locking_table_index(entry)] = entry->instrument;
+}
+#endif /* CONFIG_LOCKING_INSTRUMENT */
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+void *locking_get_call_site(locking_id_t id)
 {
-	int r = -EINVAL;
 	LOCKING_ENTRY_DECL(id);
 
-	if (entry != NULL) {
-		if (entry->type == LOCKING_TYPE_MUTEX) {
-			r = k_mutex_unlock(entry->pData);
-		} else if (entry->type == LOCKING_TYPE_SEMAPHORE) {
-			k_sem_give(entry->pData);
-			r = 0;
-		}
+	return (entry != NULL) ? call_sites[locking_table_index(entry)] : NULL;
+}
 
-#ifdef CONFIG_LOCKING_VERBOSE_DEBUGGING
-		show(entry);
+int locking_log_owners(void)
+{
+	struct locking_state states[SHOW_ALL_CHUNK];
+	locking_index_t i = 0;
+	const lte_t *entry;
+	int held = 0;
+	int count;
+	int j;
+
+	while (i < LOCKING_INDEX_COUNT) {
+		count = locking_snapshot_range(i, states, ARRAY_SIZE(states));
+		for (j = 0; j < count; j++) {
+			entry = locking_entry(i + j);
+			if (states[j].owner == NULL || !owned_once(entry)) {
+				continue;
+			}
+
+#if CONFIG_LOCKING_LONG_HOLD_MS > 0
+			LOG_WRN(CONFIG_LOCKING_SHOW_FMT
+				": held by %p for %u ms, taken at %p",
+				entry->id, entry->name, states[j].owner,
+				k_uptime_get_32() - taken_at[i + j],
+				call_sites[i + j]);
+#else
+			LOG_WRN(CONFIG_LOCKING_SHOW_FMT
+				": held by %p, taken at %p",
+				entry->id, entry->name, states[j].owner,
+				call_sites[i + j]);
 #endif
+			held++;
+		}
+		i += count;
 	}
 
-	return r;
+	return held;
 }
+#endif /* CONFIG_LOCKING_CALL_SITES */
 
+int locking_snapshot_range(locking_index_t start, struct locking_state *out,
+			   size_t n)
+{
+	k_spinlock_key_t key;
+	size_t i;
 
-/******************************************************************************/
-/* SYS INIT                                                                   */
-/******************************************************************************/
-static int locking_init(const struct device *device)
+	if (start > LOCKING_INDEX_COUNT || (out == NULL && n != 0)) {
+		return -EINVAL;
+	}
+
+	n = MIN(n, (size_t)(LOCKING_INDEX_COUNT - start));
+
+	key = k_spin_lock(&snapshot_lock);
+	for (i = 0; i < n; i++) {
+		capture_state(locking_entry(start + i), &out[i]);
+	}
+	k_spin_unlock(&snapshot_lock, key);
+
+	return (int)n;
+}
+
+int locking_snapshot(struct locking_state *out, size_t n)
 {
-	ARG_UNUSED(device);
+	return locking_snapshot_range(0, out, n);
+}
 
-	locking_table_initialise();
+int locking_snapshot_delta(struct locking_state *previous,
+			   struct locking_state *out, size_t n)
+{
+	k_spinlock_key_t key;
+	struct locking_state state;
+	locking_index_t i;
+	size_t changed = 0;
+
+	if (previous == NULL || (out == NULL && n != 0)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&snapshot_lock);
+	for (i = 0; i < LOCKING_INDEX_COUNT && changed < n; i++) {
+		capture_state(locking_entry(i), &state);
+		if (memcmp(&state, &previous[i], sizeof(state)) != 0) {
+			previous[i] = state;
+			out[changed++] = state;
+		}
+	}
+	k_spin_unlock(&snapshot_lock, key);
+
+	return (int)changed;
+}
+
+locking_id_t locking_get_id(const char *name)
+{
+#ifdef CONFIG_LOCKING_STRING_NAME
+	const lte_t *entry;
+	locking_index_t i;
+
+	for (i = 0; i < LOCKING_INDEX_COUNT; i++) {
+		entry = locking_entry(i);
+		if (entry->type != LOCKING_TYPE_UNKNOWN &&
+		    strcmp(name, entry->name) == 0) {
+			return entry->id;
+		}
+	}
+#endif
+
+	return LOCKING_INVALID_ID;
+}
+
+#ifdef CONFIG_LOCKING_SHELL
+static int shell_show(const struct shell *shell, const lte_t *const entry,
+		      const struct locking_state *state)
+{
+	uint8_t thread_name_buffer[OUTPUT_THREAD_NAME_SIZE];
+	thread_name_buffer[0] = 0;
+
+	switch (entry->type) {
+	case LOCKING_TYPE_MUTEX:
+		get_mutex_thread_name(state->owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": mutex (%d lock%s held%s%s, %d waiting)",
+			    entry->id, entry->name, state->lock_count,
+			    plural(state->lock_count),
+			    (state->lock_count == 0 ? "" : " by "),
+			    thread_name_buffer, state->waiters
+			   );
+		break;
+
+	case LOCKING_TYPE_SEMAPHORE:
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": semaphore (%d of %d lock%s free, %d waiting)",
+			    entry->id, entry->name, state->free, entry->limit,
+			    plural(entry->limit), state->waiters);
+		break;
+
+	case LOCKING_TYPE_TICKET:
+		get_mutex_thread_name(state->owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": ticket (%s%s, %d waiting)",
+			    entry->id, entry->name,
+			    (state->owner == NULL ? "free" : "held by "),
+			    thread_name_buffer, state->waiters);
+		break;
+
+	case LOCKING_TYPE_COMBINING:
+		get_mutex_thread_name(state->owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": combining (%s%s, %d pending)",
+			    entry->id, entry->name,
+			    (state->owner == NULL ? "free" : "run by "),
+			    thread_name_buffer, state->waiters);
+		break;
+
+	case LOCKING_TYPE_POOL:
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": pool (%d of %d slot%s free, %d waiting)",
+			    entry->id, entry->name, state->free, entry->limit,
+			    plural(entry->limit), state->waiters);
+		break;
+
+	case LOCKING_TYPE_BARRIER:
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": barrier (%d of %d part%s arrived, %d waiting)",
+			    entry->id, entry->name, state->lock_count,
+			    entry->limit, plural(entry->limit), state->waiters);
+		break;
+
+	case LOCKING_TYPE_PI_SEMAPHORE:
+		get_mutex_thread_name(state->owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": pi semaphore (%s%s, %d waiting, %u boosts)",
+			    entry->id, entry->name,
+			    (state->free != 0 ? "free" :
+			     (state->owner == NULL ? "held" : "held by ")),
+			    thread_name_buffer, state->waiters,
+			    ((struct locking_pi_sem *)entry->pData)->boosts);
+		break;
+
+	case LOCKING_TYPE_RATE:
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": rate (%d of %d token%s, %u/s, %d waiting)",
+			    entry->id, entry->name, state->free, entry->limit,
+			    plural(entry->limit),
+			    ((struct locking_rate *)entry->pData)->rate,
+			    state->waiters);
+		break;
+
+	case LOCKING_TYPE_LATCH:
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": latch (%s, %d of %d count%s left, %d waiting)",
+			    entry->id, entry->name,
+			    (state->free == 0 ? "open" : "closed"), state->free,
+			    entry->count, plural(entry->count), state->waiters);
+		break;
+
+	default:
+		shell_print(shell, CONFIG_LOCKING_SHOW_FMT
+			    ": unknown type %d", entry->id, entry->name,
+			    entry->type);
+		break;
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_LOCKING_STATS
+static void shell_show_stats(const struct shell *shell, const lte_t *const entry)
+{
+	struct locking_stats total;
+
+	locking_stats_total(entry, &total);
+	shell_print(shell, "      takes %u gives %u contended %u timeouts %u",
+		    (uint32_t)atomic_get(&total.takes),
+		    (uint32_t)atomic_get(&total.gives),
+		    (uint32_t)atomic_get(&total.contended),
+		    (uint32_t)atomic_get(&total.timeouts));
+#ifdef CONFIG_LOCKING_HANDOFF
+	shell_print(shell, "      handoffs %u",
+		    (uint32_t)atomic_get(&total.handoffs));
+#endif
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	if (LEVEL(entry) >= LOCKING_INSTRUMENT_TIMING) {
+		shell_print(shell, "      longest wait %u us hold %u us",
+			    k_cyc_to_us_floor32(atomic_get(&total.wait_max)),
+			    k_cyc_to_us_floor32(atomic_get(&total.hold_max)));
+	}
+#endif
+}
+#endif
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+/* Resolve the address with addr2line -e zephyr.elf */
+static void shell_show_call_site(const struct shell *shell,
+				 const lte_t *const entry,
+				 const struct locking_state *state)
+{
+	locking_index_t index = locking_table_index(entry);
+
+	if (state->owner == NULL || !owned_once(entry)) {
+		return;
+	}
+
+#if CONFIG_LOCKING_LONG_HOLD_MS > 0
+	shell_print(shell, "      taken at %p %u ms ago", call_sites[index],
+		    k_uptime_get_32() - taken_at[index]);
+#else
+	shell_print(shell, "      taken at %p", call_sites[index]);
+#endif
+}
+#endif
+
+#ifdef CONFIG_LOCKING_POOL
+static void shell_show_pool(const struct shell *shell, const lte_t *const entry)
+{
+	uint8_t thread_name_buffer[OUTPUT_THREAD_NAME_SIZE];
+	struct k_thread *owner;
+	uint16_t i;
+
+	for (i = 0; i < entry->limit; i++) {
+		if (!locking_pool_slot_used(entry->pData, i, &owner)) {
+			continue;
+		}
+
+		/* Owners are only known with CONFIG_LOCKING_POOL_CHECKS */
+		get_mutex_thread_name(owner, thread_name_buffer,
+				      sizeof(thread_name_buffer));
+		shell_print(shell, "      slot %u in use%s%s", i,
+			    (owner == NULL ? "" : " by "), thread_name_buffer);
+	}
+}
+#endif
+
+#ifdef CONFIG_LOCKING_STRIPED
+/* One line per stripe, uneven contention means the keys hash poorly */
+static void shell_show_stripes(const struct shell *shell,
+			       const lte_t *const entry)
+{
+	uint8_t thread_name_buffer[OUTPUT_THREAD_NAME_SIZE];
+	struct locking_state state;
+	k_spinlock_key_t key;
+	uint16_t i;
+
+	for (i = 0; i < STRIPES(entry); i++) {
+		memset(&state, 0, sizeof(state));
+		key = k_spin_lock(&snapshot_lock);
+		capture_object(entry, STRIPE(entry, entry->pData, i), &state);
+		k_spin_unlock(&snapshot_lock, key);
+
+		get_mutex_thread_name(state.owner, thread_name_buffer,
+				      sizeof(thread_name_buffer));
+#ifdef CONFIG_LOCKING_STATS
+		shell_print(shell,
+			    "      [%u] %s%s, %d waiting, takes %u contended %u",
+			    i, (state.owner == NULL ? "free" : "held by "),
+			    thread_name_buffer, state.waiters,
+			    (uint32_t)atomic_get(&stripe_stats(entry, i)->takes),
+			    (uint32_t)atomic_get(
+				    &stripe_stats(entry, i)->contended));
+#else
+		shell_print(shell, "      [%u] %s%s, %d waiting", i,
+			    (state.owner == NULL ? "free" : "held by "),
+			    thread_name_buffer, state.waiters);
+#endif
+	}
+}
+#endif
+
+#ifdef CONFIG_LOCKING_TICKET
+static void shell_show_ticket(const struct shell *shell,
+			      const lte_t *const entry)
+{
+	struct locking_ticket_metrics m;
+
+	locking_ticket_metrics_get(entry->pData, &m);
+	if (m.waits == 0) {
+		shell_print(shell, "      no waits, max bypass %u", m.max_bypass);
+		return;
+	}
+
+	/* The spread between the shortest and longest wait shows starvation */
+	shell_print(shell,
+		    "      waits %u min %llu us avg %llu us max %llu us, "
+		    "max bypass %u",
+		    m.waits, k_cyc_to_us_floor64(m.min_wait),
+		    k_cyc_to_us_floor64(m.total_wait / m.waits),
+		    k_cyc_to_us_floor64(m.max_wait), m.max_bypass);
+}
+#endif
+
+#ifdef CONFIG_LOCKING_COMBINING
+static void shell_show_combining(const struct shell *shell,
+				 const lte_t *const entry)
+{
+	struct locking_combining_metrics m;
+
+	locking_combining_metrics_get(entry->pData, &m);
+
+	/* A high share of combined sections means the batching is working */
+	shell_print(shell,
+		    "      ops %u (%u combined) batches %u max batch %u "
+		    "handoffs %u",
+		    m.ops, m.combined, m.batches, m.max_batch, m.handoffs);
+}
+#endif
+
+int locking_show(const struct shell *shell, locking_id_t id)
+{
+	int r = -EINVAL;
+	struct locking_state state;
+	k_spinlock_key_t key;
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry != NULL) {
+		key = k_spin_lock(&snapshot_lock);
+		capture_state(entry, &state);
+		k_spin_unlock(&snapshot_lock, key);
+
+		r = shell_show(shell, entry, &state);
+#ifdef CONFIG_LOCKING_CALL_SITES
+		shell_show_call_site(shell, entry, &state);
+#endif
+#ifdef CONFIG_LOCKING_STATS
+		shell_show_stats(shell, entry);
+#endif
+#ifdef CONFIG_LOCKING_TICKET
+		if (entry->type == LOCKING_TYPE_TICKET) {
+			shell_show_ticket(shell, entry);
+		}
+#endif
+#ifdef CONFIG_LOCKING_COMBINING
+		if (entry->type == LOCKING_TYPE_COMBINING) {
+			shell_show_combining(shell, entry);
+		}
+#endif
+#ifdef CONFIG_LOCKING_POOL
+		if (entry->type == LOCKING_TYPE_POOL) {
+			shell_show_pool(shell, entry);
+		}
+#endif
+#ifdef CONFIG_LOCKING_STRIPED
+		if (STRIPES(entry) > 1) {
+			shell_show_stripes(shell, entry);
+		}
+#endif
+	}
+
+	return r;
+}
+
+int locking_show_all(const struct shell *shell)
+{
+	struct locking_state states[SHOW_ALL_CHUNK];
+	locking_index_t i = 0;
+	int count;
+	int j;
+
+	while (i < LOCKING_INDEX_COUNT) {
+		count = locking_snapshot_range(i, states, ARRAY_SIZE(states));
+		for (j = 0; j < count; j++) {
+			/* Skip unused runtime lock slots */
+			if (states[j].type != LOCKING_TYPE_UNKNOWN) {
+				(void)shell_show(shell, locking_entry(i + j),
+						 &states[j]);
+			}
+		}
+		i += count;
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_LOCKING_STATS
+/* Read back by locking_advisor.py from a console log, keys that are missing
+ * (options not enabled) are treated as unknown. Times are in microseconds.
+ */
+int locking_show_profile(const struct shell *shell)
+{
+	const lte_t *entry;
+	struct locking_stats total;
+	locking_index_t i;
+
+	shell_print(shell, "profile {\"uptime_ms\": %u}", k_uptime_get_32());
+
+	for (i = 0; i < LOCKING_INDEX_COUNT; i++) {
+		entry = locking_entry(i);
+		/* Skip unused runtime lock slots */
+		if (entry->type == LOCKING_TYPE_UNKNOWN) {
+			continue;
+		}
+
+		locking_stats_total(entry, &total);
+#ifdef CONFIG_LOCKING_INSTRUMENT
+		shell_print(shell,
+			    "profile {\"id\": %u, \"level\": %u, "
+			    "\"takes\": %u, \"gives\": %u, "
+			    "\"contended\": %u, \"timeouts\": %u, "
+			    "\"isr_takes\": %u, \"depth_max\": %u, "
+			    "\"wait_max_us\": %u, \"hold_max_us\": %u}",
+			    entry->id, LEVEL(entry),
+			    (uint32_t)atomic_get(&total.takes),
+			    (uint32_t)atomic_get(&total.gives),
+			    (uint32_t)atomic_get(&total.contended),
+			    (uint32_t)atomic_get(&total.timeouts),
+			    (uint32_t)atomic_get(&total.isr_takes),
+			    (uint32_t)atomic_get(&total.depth_max),
+			    k_cyc_to_us_floor32(atomic_get(&total.wait_max)),
+			    k_cyc_to_us_floor32(atomic_get(&total.hold_max)));
+#else
+		shell_print(shell,
+			    "profile {\"id\": %u, \"takes\": %u, "
+			    "\"gives\": %u, \"contended\": %u, "
+			    "\"timeouts\": %u}",
+			    entry->id, (uint32_t)atomic_get(&total.takes),
+			    (uint32_t)atomic_get(&total.gives),
+			    (uint32_t)atomic_get(&total.contended),
+			    (uint32_t)atomic_get(&total.timeouts));
+#endif
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+int locking_show_holders(const struct shell *shell, locking_id_t id)
+{
+	uint8_t thread_name_buffer[OUTPUT_THREAD_NAME_SIZE];
+	struct locking_holder holder[SHOW_ALL_CHUNK];
+	uint32_t now = k_uptime_get_32();
+	int count;
+	int i;
+	LOCKING_ENTRY_DECL(id);
+
+	count = locking_get_holders(id, holder, ARRAY_SIZE(holder));
+	if (count < 0) {
+		return count;
+	}
+
+	shell_print(shell, CONFIG_LOCKING_SHOW_FMT ": %d of %d unit%s held",
+		    entry->id, entry->name,
+		    entry->limit - k_sem_count_get(entry->pData), entry->limit,
+		    plural(entry->limit));
+
+	for (i = 0; i < count; i++) {
+		if (holder[i].thread == NULL) {
+			strcpy(thread_name_buffer, "ISR");
+		} else {
+			get_mutex_thread_name(holder[i].thread,
+					      thread_name_buffer,
+					      sizeof(thread_name_buffer));
+		}
+		shell_print(shell, "      %s for %u ms from %p",
+			    thread_name_buffer, now - holder[i].since,
+			    holder[i].call_site);
+	}
+
+	/* Only the first records of a large pool fit in the stack buffer */
+	if (count == ARRAY_SIZE(holder)) {
+		shell_print(shell, "      (first %d shown)", count);
+	}
+
+	if (entry->holders->untracked != 0) {
+		shell_print(shell, "      %d untracked",
+			    entry->holders->untracked);
+	}
+
+	return 0;
+}
+#endif
+
+int locking_show_memory(const struct shell *shell)
+{
+	shell_print(shell, "Lock objects: %zu bytes", LOCKING_FOOTPRINT.objects);
+	shell_print(shell, "Cache line aligned: %zu bytes (%zu padding, line %u)",
+		    LOCKING_FOOTPRINT.aligned, LOCKING_FOOTPRINT.padding,
+		    CONFIG_LOCKING_CACHE_LINE_SIZE);
+	shell_print(shell, "Table: %zu bytes, map: %zu bytes, names: %zu bytes",
+		    LOCKING_FOOTPRINT.table, LOCKING_FOOTPRINT.map,
+		    LOCKING_FOOTPRINT.names);
+
+	return 0;
+}
+
+#endif /* CONFIG_LOCKING_SHELL */
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+#ifdef CONFIG_LOCKING_VERBOSE_DEBUGGING
+static int show(const lte_t *const entry)
+{
+	uint8_t thread_name_buffer[OUTPUT_THREAD_NAME_SIZE];
+	struct locking_state state;
+	k_spinlock_key_t key;
+	thread_name_buffer[0] = 0;
+
+	key = k_spin_lock(&snapshot_lock);
+	capture_state(entry, &state);
+	k_spin_unlock(&snapshot_lock, key);
+
+	switch (entry->type) {
+	case LOCKING_TYPE_MUTEX:
+		get_mutex_thread_name(state.owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": mutex (%d lock%s held%s%s)",
+			 entry->id, entry->name, state.lock_count,
+			 plural(state.lock_count),
+			 (state.lock_count == 0 ? "" : " by "),
+			 thread_name_buffer
+			);
+		break;
+
+	case LOCKING_TYPE_SEMAPHORE:
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT
+			 ": semaphore (%d of %d lock%s free)",
+			 entry->id, entry->name, state.free, entry->limit,
+			 plural(entry->limit));
+		break;
+
+	case LOCKING_TYPE_TICKET:
+		get_mutex_thread_name(state.owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": ticket (%s%s)",
+			 entry->id, entry->name,
+			 (state.owner == NULL ? "free" : "held by "),
+			 thread_name_buffer);
+		break;
+
+	case LOCKING_TYPE_COMBINING:
+		get_mutex_thread_name(state.owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": combining (%s%s)",
+			 entry->id, entry->name,
+			 (state.owner == NULL ? "free" : "run by "),
+			 thread_name_buffer);
+		break;
+
+	case LOCKING_TYPE_POOL:
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": pool (%d of %d slot%s free)",
+			 entry->id, entry->name, state.free, entry->limit,
+			 plural(entry->limit));
+		break;
+
+	case LOCKING_TYPE_BARRIER:
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT
+			 ": barrier (%d of %d part%s arrived)",
+			 entry->id, entry->name, state.lock_count, entry->limit,
+			 plural(entry->limit));
+		break;
+
+	case LOCKING_TYPE_PI_SEMAPHORE:
+		get_mutex_thread_name(state.owner,
+				      thread_name_buffer,
+				      sizeof(thread_name_buffer));
+
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": pi semaphore (%s%s)",
+			 entry->id, entry->name,
+			 (state.free != 0 ? "free" :
+			  (state.owner == NULL ? "held" : "held by ")),
+			 thread_name_buffer);
+		break;
+
+	case LOCKING_TYPE_RATE:
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": rate (%d of %d token%s)",
+			 entry->id, entry->name, state.free, entry->limit,
+			 plural(entry->limit));
+		break;
+
+	case LOCKING_TYPE_LATCH:
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": latch (%d count%s left)",
+			 entry->id, entry->name, state.free, plural(state.free));
+		break;
+
+	default:
+		LOG_SHOW(CONFIG_LOCKING_SHOW_FMT ": unknown type %d",
+			 entry->id, entry->name, entry->type);
+		break;
+	}
+
+	return 0;
+}
+#endif
+
+/* Must be called with snapshot_lock held */
+static void capture_state(const lte_t *const entry,
+			  struct locking_state *state)
+{
+#ifdef CONFIG_LOCKING_STRIPED
+	struct locking_state stripe;
+	uint16_t i;
+#endif
+
+	/* Zero padding too so that states can be compared with memcmp */
+	memset(state, 0, sizeof(*state));
+	state->index = locking_table_index(entry);
+	state->id = entry->id;
+	state->type = entry->type;
+
+	capture_object(entry, entry->pData, state);
+
+#ifdef CONFIG_LOCKING_STRIPED
+	/* A striped lock is held if any stripe is, the owner shown is the
+	 * holder of the lowest held stripe.
+	 */
+	for (i = 1; i < STRIPES(entry); i++) {
+		memset(&stripe, 0, sizeof(stripe));
+		capture_object(entry, STRIPE(entry, entry->pData, i), &stripe);
+		if (state->owner == NULL) {
+			state->owner = stripe.owner;
+		}
+		state->lock_count += stripe.lock_count;
+		state->waiters = (uint16_t)MIN((uint32_t)state->waiters +
+						       stripe.waiters,
+					       UINT16_MAX);
+	}
+#endif
+}
+
+/* Fills in the type specific fields, snapshot_lock must be held */
+static void capture_object(const lte_t *const entry, void *object,
+			   struct locking_state *state)
+{
+	struct k_mutex *mutex;
+	struct k_sem *sem;
+	struct locking_ticket *ticket;
+	struct locking_combining *combining;
+	struct locking_pool *pool;
+	struct locking_barrier *barrier;
+	struct locking_latch *latch;
+	struct locking_pi_sem *pi;
+#ifdef CONFIG_LOCKING_RATE
+	struct locking_rate *rate;
+#endif
+
+	switch (entry->type) {
+	case LOCKING_TYPE_MUTEX:
+		mutex = (struct k_mutex *)object;
+		state->lock_count = mutex->lock_count;
+		state->owner = (mutex->lock_count == 0) ? NULL : mutex->owner;
+		state->waiters = wait_q_count(&mutex->wait_q);
+		break;
+
+	case LOCKING_TYPE_SEMAPHORE:
+		sem = (struct k_sem *)object;
+		state->free = k_sem_count_get(sem);
+		state->waiters = wait_q_count(&sem->wait_q);
+		break;
+
+	case LOCKING_TYPE_TICKET:
+		ticket = (struct locking_ticket *)object;
+		state->owner = ticket->owner;
+		state->lock_count = (ticket->owner == NULL) ? 0 : 1;
+		state->waiters = (uint16_t)MIN(sys_dlist_len(&ticket->queue),
+					       UINT16_MAX);
+		break;
+
+	case LOCKING_TYPE_COMBINING:
+		combining = (struct locking_combining *)object;
+		state->owner = combining->combiner;
+		state->lock_count = (combining->combiner == NULL) ? 0 : 1;
+		state->waiters = combining->waiting;
+		break;
+
+	case LOCKING_TYPE_POOL:
+		pool = (struct locking_pool *)object;
+		state->free = k_sem_count_get(&pool->sem);
+		state->waiters = wait_q_count(&pool->sem.wait_q);
+		break;
+
+	case LOCKING_TYPE_BARRIER:
+		barrier = (struct locking_barrier *)object;
+		state->lock_count = barrier->arrived;
+		state->waiters = wait_q_count(&barrier->cond.wait_q);
+		break;
+
+	case LOCKING_TYPE_LATCH:
+		latch = (struct locking_latch *)object;
+		state->free = latch->count;
+		state->waiters = wait_q_count(&latch->gate.wait_q);
+		break;
+
+	case LOCKING_TYPE_PI_SEMAPHORE:
+		pi = (struct locking_pi_sem *)object;
+		state->owner = pi->held ? pi->holder : NULL;
+		state->lock_count = pi->held ? 1 : 0;
+		state->free = k_sem_count_get(&pi->sem);
+		state->waiters = wait_q_count(&pi->sem.wait_q);
+		break;
+
+#ifdef CONFIG_LOCKING_RATE
+	case LOCKING_TYPE_RATE:
+		rate = (struct locking_rate *)object;
+		state->free = locking_rate_tokens(rate);
+		state->waiters = (uint16_t)atomic_get(&rate->waiting);
+		break;
+#endif
+
+	default:
+		break;
+	}
+}
+
+static uint16_t wait_q_count(_wait_q_t *wait_q)
+{
+	size_t count = 0;
+#ifdef CONFIG_WAITQ_SCALABLE
+	struct rbnode *node;
+
+	RB_FOR_EACH(&wait_q->waitq.tree, node) {
+		count++;
+	}
+#else
+	count = sys_dlist_len(&wait_q->waitq);
+#endif
+
+	return (uint16_t)MIN(count, UINT16_MAX);
+}
+
+#if defined(CONFIG_LOCKING_VERBOSE_DEBUGGING) || defined(CONFIG_LOCKING_SHELL)
+static const char *plural(uint8_t input)
+{
+	if (input == 1) {
+		return EMPTY_STRING;
+	}
+
+	return "s";
+}
+
+#ifdef CONFIG_THREAD_NAME
+static void get_mutex_thread_name(struct k_thread *mutex_owner_thread,
+				  uint8_t *buffer, uint8_t buffer_size)
+{
+	if (mutex_owner_thread == NULL) {
+		buffer[0] = 0;
+		return;
+	} else if (mutex_owner_thread->name == NULL) {
+		snprintk(buffer, buffer_size, "%p", mutex_owner_thread);
+		return;
+	}
+
+	strncpy(buffer, mutex_owner_thread->name, buffer_size);
+	buffer[(buffer_size - 1)] = 0;
+}
+#else
+static void get_mutex_thread_name(struct k_thread *mutex_owner_thread,
+				  uint8_t *buffer, uint8_t buffer_size)
+{
+	if (mutex_owner_thread == NULL) {
+		buffer[0] = 0;
+		return;
+	}
+
+	snprintk(buffer, buffer_size, "%p", mutex_owner_thread);
+}
+#endif
+
+#endif
+
+static int take_object(const lte_t *const entry, uint16_t stripe,
+		       k_timeout_t wait_time)
+{
+	void *object = STRIPE(entry, entry->pData, stripe);
+	int r = -EINVAL;
+
+	if (entry->type == LOCKING_TYPE_MUTEX) {
+		r = k_mutex_lock(object, wait_time);
+	} else if (entry->type == LOCKING_TYPE_SEMAPHORE) {
+		r = k_sem_take(object, wait_time);
+#ifdef CONFIG_LOCKING_TICKET
+	} else if (entry->type == LOCKING_TYPE_TICKET) {
+		r = locking_ticket_take(object, wait_time);
+#endif
+#ifdef CONFIG_LOCKING_RATE
+	} else if (entry->type == LOCKING_TYPE_RATE) {
+		r = locking_rate_take(object, wait_time);
+#endif
+#ifdef CONFIG_LOCKING_PI_SEMAPHORE
+	} else if (entry->type == LOCKING_TYPE_PI_SEMAPHORE) {
+		r = locking_pi_sem_take(object, wait_time);
+#endif
+	}
+
+	return r;
+}
+
+static int give_object(const lte_t *const entry, uint16_t stripe)
+{
+	void *object = STRIPE(entry, entry->pData, stripe);
+	int r = -EINVAL;
+
+	if (entry->type == LOCKING_TYPE_MUTEX) {
+		r = k_mutex_unlock(object);
+	} else if (entry->type == LOCKING_TYPE_SEMAPHORE) {
+		k_sem_give(object);
+		r = 0;
+#ifdef CONFIG_LOCKING_TICKET
+	} else if (entry->type == LOCKING_TYPE_TICKET) {
+		r = locking_ticket_give(object);
+#endif
+	} else if (entry->type == LOCKING_TYPE_RATE) {
+		/* Tokens are used up, the bucket refills with time */
+		r = -ENOTSUP;
+#ifdef CONFIG_LOCKING_PI_SEMAPHORE
+	} else if (entry->type == LOCKING_TYPE_PI_SEMAPHORE) {
+		r = locking_pi_sem_give(object);
+#endif
+	}
+
+	return r;
+}
+
+int locking_take(locking_id_t id, k_timeout_t wait_time)
+{
+	int r = -EINVAL;
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry != NULL) {
+		r = take_entry(entry, id, 0, wait_time,
+			       __builtin_return_address(0));
+	}
+
+	return r;
+}
+
+int locking_give(locking_id_t id)
+{
+	int r = -EINVAL;
+	LOCKING_ENTRY_DECL(id);
+
+	if (entry != NULL) {
+		r = give_entry(entry, id, 0, __builtin_return_address(0));
+	}
+
+	return r;
+}
+
+int locking_take_entry(const lte_t *const entry, locking_id_t id,
+		       k_timeout_t wait_time)
+{
+	return take_entry(entry, id, 0, wait_time,
+			  __builtin_return_address(0));
+}
+
+int locking_give_entry(const lte_t *const entry, locking_id_t id)
+{
+	return give_entry(entry, id, 0, __builtin_return_address(0));
+}
+
+#ifdef CONFIG_LOCKING_HANDOFF
+int locking_handoff(locking_id_t id, struct k_thread *to)
+{
+	void *call_site = __builtin_return_address(0);
+	int r = -EINVAL;
+	LOCKING_ENTRY_DECL(id);
+
+	/* A handoff to the caller would succeed without checking that the
+	 * caller holds the lock, and striped locks have no single owner.
+	 */
+	if (entry == NULL || to == NULL || to == k_current_get() ||
+	    STRIPES(entry) > 1 || k_is_in_isr()) {
+		return r;
+	}
+
+	r = handoff_object(entry, 0, to, call_site);
+	if (r == 0) {
+		handed_off(entry, 0, to, call_site);
+	}
+
+	return r;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+void locking_stats_total(const lte_t *const entry, struct locking_stats *total)
+{
+	struct locking_stats *stats;
+	uint16_t i;
+
+	memset(total, 0, sizeof(*total));
+	for (i = 0; i < STRIPES(entry); i++) {
+		stats = stripe_stats(entry, i);
+		atomic_add(&total->takes, atomic_get(&stats->takes));
+		atomic_add(&total->gives, atomic_get(&stats->gives));
+		atomic_add(&total->contended, atomic_get(&stats->contended));
+		atomic_add(&total->timeouts, atomic_get(&stats->timeouts));
+		atomic_add(&total->handoffs, atomic_get(&stats->handoffs));
+#ifdef CONFIG_LOCKING_INSTRUMENT
+		update_max(&total->wait_max, atomic_get(&stats->wait_max));
+		update_max(&total->hold_max, atomic_get(&stats->hold_max));
+		atomic_add(&total->isr_takes, atomic_get(&stats->isr_takes));
+		update_max(&total->depth_max, atomic_get(&stats->depth_max));
+#endif
+	}
+}
+
+static struct locking_stats *stripe_stats(const lte_t *const entry,
+					  uint16_t stripe)
+{
+	return STRIPE(entry, entry->stats, stripe);
+}
+
+/* Try first so that contention can be counted */
+static int take_counted(const lte_t *const entry, uint16_t stripe,
+			k_timeout_t wait_time, bool *contended)
+{
+	int r;
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	uint32_t start;
+#endif
+
+	r = take_object(entry, stripe, K_NO_WAIT);
+	if (r == 0 || r == -EINVAL || K_TIMEOUT_EQ(wait_time, K_NO_WAIT)) {
+#ifdef CONFIG_LOCKING_BLAME
+		if (r != -EINVAL && LEVEL(entry) >= LOCKING_INSTRUMENT_TIMING) {
+			locking_blame_add(entry, r, r != 0, 0);
+		}
+#endif
+		return r;
+	}
+
+	*contended = true;
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	if (LEVEL(entry) >= LOCKING_INSTRUMENT_TIMING) {
+		start = k_cycle_get_32();
+		r = take_object(entry, stripe, wait_time);
+		start = k_cycle_get_32() - start;
+		update_max(&stripe_stats(entry, stripe)->wait_max, start);
+#ifdef CONFIG_LOCKING_BLAME
+		locking_blame_add(entry, r, true, start);
+#endif
+		return r;
+	}
+#endif
+
+	return take_object(entry, stripe, wait_time);
+}
+#endif
+
+#if defined(CONFIG_LOCKING_INSTRUMENT) || defined(CONFIG_LOCKING_CALL_SITES)
+/* Hold times and call sites are only recorded where one thread holds the
+ * lock, from the outermost take of a mutex. A give from another thread
+ * (which fails) is not the end of a hold.
+ */
+static bool exclusive(const lte_t *const entry, uint16_t stripe)
+{
+	struct k_mutex *mutex = STRIPE(entry, entry->pData, stripe);
+	struct locking_ticket *ticket = STRIPE(entry, entry->pData, stripe);
+
+	if (entry->type == LOCKING_TYPE_MUTEX) {
+		return mutex->lock_count == 1 && mutex->owner == k_current_get();
+	} else if (entry->type == LOCKING_TYPE_TICKET) {
+		return ticket->owner == k_current_get();
+	}
+
+	return false;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+static void update_max(atomic_t *max, uint32_t value)
+{
+	atomic_val_t old;
+
+	do {
+		old = atomic_get(max);
+		if ((uint32_t)old >= value) {
+			return;
+		}
+	} while (!atomic_cas(max, old, (atomic_val_t)value));
+}
+
+/* How deep the lock is held just after a take, recursion of a mutex or
+ * units of a semaphore. Other types are held once per take.
+ */
+static uint32_t depth(const lte_t *const entry, uint16_t stripe)
+{
+	struct k_mutex *mutex = STRIPE(entry, entry->pData, stripe);
+
+	if (entry->type == LOCKING_TYPE_MUTEX) {
+		return mutex->lock_count;
+	} else if (entry->type == LOCKING_TYPE_SEMAPHORE) {
+		return entry->limit - k_sem_count_get(entry->pData);
+	}
+
+	return 1;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+static void owner_giving(const lte_t *const entry, void *call_site)
+{
+#if CONFIG_LOCKING_LONG_HOLD_MS > 0
+	locking_index_t index = locking_table_index(entry);
+	uint32_t held = k_uptime_get_32() - taken_at[index];
+
+	if (held >= CONFIG_LOCKING_LONG_HOLD_MS) {
+		LOG_WRN(CONFIG_LOCKING_SHOW_FMT
+			": held for %u ms, taken at %p, given at %p",
+			entry->id, entry->name, held, call_sites[index],
+			call_site);
+	}
+#else
+	ARG_UNUSED(entry);
+	ARG_UNUSED(call_site);
+#endif
+}
+
+/* Mutex and ticket locks with a single owner, which the call site belongs
+ * to. The stripes of a striped lock are owned separately.
+ */
+static bool owned_once(const lte_t *const entry)
+{
+	return (entry->type == LOCKING_TYPE_MUTEX ||
+		entry->type == LOCKING_TYPE_TICKET) &&
+	       STRIPES(entry) == 1;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_STRIPED
+/* Mix the high bits of the key into the low ones (keys are often pointers
+ * or IDs that differ in a few bits), then mask to the power of two count.
+ */
+static uint16_t key_stripe(const lte_t *const entry, uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x45d9f3b;
+	key ^= key >> 16;
+
+	return key & (STRIPES(entry) - 1);
+}
+#endif
+
+static int take_entry(const lte_t *const entry, locking_id_t id,
+		      uint16_t stripe, k_timeout_t wait_time, void *call_site)
+{
+	bool contended = false;
+	int r;
+
+	if (!PIN(entry, id)) {
+		return -EINVAL;
+	}
+
+	taking(entry);
+
+#ifdef CONFIG_LOCKING_STATS
+	if (LEVEL(entry) >= LOCKING_INSTRUMENT_COUNTERS) {
+		r = take_counted(entry, stripe, wait_time, &contended);
+	} else {
+		r = take_object(entry, stripe, wait_time);
+	}
+#else
+	r = take_object(entry, stripe, wait_time);
+#endif
+
+	taken(entry, stripe, r, contended, call_site);
+	UNPIN(entry);
+
+	return r;
+}
+
+static void taking(const lte_t *const entry)
+{
+	if (LEVEL(entry) >= LOCKING_INSTRUMENT_TRACE) {
+		locking_trace_take_enter(entry);
+	}
+}
+
+/* Accounting common to every way of taking a lock. Holders are tracked
+ * whatever the level so that a record is never left behind.
+ */
+static void taken(const lte_t *const entry, uint16_t stripe, int r,
+		  bool contended, void *call_site)
+{
+	uint8_t level = LEVEL(entry);
+#ifdef CONFIG_LOCKING_STATS
+	struct locking_stats *stats = stripe_stats(entry, stripe);
+#endif
+
+	ARG_UNUSED(stripe);
+	ARG_UNUSED(contended);
+	ARG_UNUSED(call_site);
+
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		locking_trace_take_exit(entry, r);
+	}
+
+#ifdef CONFIG_LOCKING_PERSIST
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		locking_persist_event(entry,
+				      (r == 0) ? LOCKING_EVENT_TAKE :
+						 LOCKING_EVENT_TAKE_FAILED,
+				      r);
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+	if (r == 0) {
+		locking_holders_add(entry, call_site);
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+	if (level >= LOCKING_INSTRUMENT_COUNTERS) {
+		if (contended) {
+			atomic_inc(&stats->contended);
+		}
+
+		if (r == 0) {
+			atomic_inc(&stats->takes);
+		} else if (r != -EINVAL) {
+			atomic_inc(&stats->timeouts);
+		}
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	if (r == 0 && level >= LOCKING_INSTRUMENT_COUNTERS) {
+		if (k_is_in_isr()) {
+			atomic_inc(&stats->isr_takes);
+		}
+		update_max(&stats->depth_max, depth(entry, stripe));
+	}
+
+	if (r == 0 && level >= LOCKING_INSTRUMENT_TIMING &&
+	    exclusive(entry, stripe)) {
+		stats->held_since = k_cycle_get_32();
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+	if (r == 0 && owned_once(entry) && exclusive(entry, stripe)) {
+		call_sites[locking_table_index(entry)] = call_site;
+#if CONFIG_LOCKING_LONG_HOLD_MS > 0
+		taken_at[locking_table_index(entry)] = k_uptime_get_32();
+#endif
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_VERBOSE_DEBUGGING
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		show(entry);
+	}
+#endif
+}
+
+static int give_entry(const lte_t *const entry, locking_id_t id,
+		      uint16_t stripe, void *call_site)
+{
+	int r;
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	struct locking_stats *stats = stripe_stats(entry, stripe);
+#endif
+
+	if (!PIN(entry, id)) {
+		return -EINVAL;
+	}
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+
+	/* Before the give, held_since belongs to the next holder after it.
+	 * A lock taken before its level was raised has no start time.
+	 */
+	if (LEVEL(entry) >= LOCKING_INSTRUMENT_TIMING &&
+	    exclusive(entry, stripe) && stats->held_since != 0) {
+		update_max(&stats->hold_max,
+			   k_cycle_get_32() - stats->held_since);
+		stats->held_since = 0;
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+	if (owned_once(entry) && exclusive(entry, stripe)) {
+		owner_giving(entry, call_site);
+	}
+#else
+	ARG_UNUSED(call_site);
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+	/* Before the give, a unit can be taken again as soon as it is given */
+	locking_holders_remove(entry);
+#endif
+
+	r = give_object(entry, stripe);
+
+	given(entry, stripe, r);
+
+#ifdef CONFIG_LOCKING_ASYNC
+	if (r == 0) {
+		locking_async_given(entry);
+	}
+#endif
+	UNPIN(entry);
+
+	return r;
+}
+
+/* Accounting common to every way of giving a lock */
+static void given(const lte_t *const entry, uint16_t stripe, int r)
+{
+	uint8_t level = LEVEL(entry);
+
+	ARG_UNUSED(stripe);
+
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		locking_trace_give(entry, r);
+	}
+
+#ifdef CONFIG_LOCKING_PERSIST
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		locking_persist_event(entry, LOCKING_EVENT_GIVE, r);
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+	if (r == 0 && level >= LOCKING_INSTRUMENT_COUNTERS) {
+		atomic_inc(&stripe_stats(entry, stripe)->gives);
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_VERBOSE_DEBUGGING
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		show(entry);
+	}
+#endif
+}
+
+#ifdef CONFIG_LOCKING_HANDOFF
+static int handoff_object(const lte_t *const entry, uint16_t stripe,
+			  struct k_thread *to, void *call_site)
+{
+	void *object = STRIPE(entry, entry->pData, stripe);
+	int r = -ENOTSUP;
+
+	ARG_UNUSED(object);
+	ARG_UNUSED(call_site);
+
+	/* The kernel cannot hand over a k_mutex, pi_semaphore locks can */
+	if (entry->type == LOCKING_TYPE_SEMAPHORE) {
+		/* A semaphore has no owner, only the holder record moves.
+		 * Without one there is no way to tell that the caller holds
+		 * a unit.
+		 */
+#ifdef CONFIG_LOCKING_HOLDERS
+		r = locking_holders_handoff(entry, to, call_site);
+		if (r == -ENOENT) {
+			r = -EPERM;
+		}
+#endif
+#ifdef CONFIG_LOCKING_TICKET
+	} else if (entry->type == LOCKING_TYPE_TICKET) {
+		r = locking_ticket_handoff(object, to);
+#endif
+#ifdef CONFIG_LOCKING_PI_SEMAPHORE
+	} else if (entry->type == LOCKING_TYPE_PI_SEMAPHORE) {
+		r = locking_pi_sem_handoff(object, to);
+#endif
+	}
+
+	return r;
+}
+
+/* Accounting of a handoff. The lock is never free, so the hold time and
+ * the time it was taken carry over to the new owner.
+ */
+static void handed_off(const lte_t *const entry, uint16_t stripe,
+		       struct k_thread *to, void *call_site)
+{
+	uint8_t level = LEVEL(entry);
+
+	ARG_UNUSED(stripe);
+	ARG_UNUSED(call_site);
+
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		locking_trace_handoff(entry, to);
+	}
+
+#ifdef CONFIG_LOCKING_PERSIST
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		locking_persist_event(entry, LOCKING_EVENT_HANDOFF, 0);
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+	if (level >= LOCKING_INSTRUMENT_COUNTERS) {
+		atomic_inc(&stripe_stats(entry, stripe)->handoffs);
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_CALL_SITES
+	if (owned_once(entry)) {
+		call_sites[locking_table_index(entry)] = call_site;
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_VERBOSE_DEBUGGING
+	if (level >= LOCKING_INSTRUMENT_TRACE) {
+		show(entry);
+	}
+#endif
+}
+#endif
+
+/******************************************************************************/
+/* SYS INIT                                                                   */
+/******************************************************************************/
+static int locking_init(const struct device *device)
+{
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	locking_index_t i;
+#endif
+#ifdef CONFIG_LOCKING_BENCH
+	uint32_t start;
+#endif
+
+	ARG_UNUSED(device);
+
+#ifdef CONFIG_LOCKING_BENCH
+	start = k_cycle_get_32();
+	locking_table_initialise();
+	locking_bench_initialised(k_cycle_get_32() - start);
+#else
+	locking_table_initialise();
+#endif
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	for (i = 0; i < LOCKING_TABLE_SIZE; i++) {
+		locking_instrument_reset(locking_entry(i));
+	}
+#endif
+
+#ifdef CONFIG_LOCKING_PERSIST
+	locking_persist_init();
+#endif
 
 	return 0;
 }
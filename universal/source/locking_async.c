@@ -0,0 +1,332 @@
+/**
+ * @file locking_async.c
+ * @brief Asynchronous lock requests granted from the system work queue
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <logging/log.h>
+LOG_MODULE_DECLARE(locking, CONFIG_LOCKING_LOG_LEVEL);
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <sys/dlist.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+struct async_queue {
+	/* Pending requests, highest priority (lowest value) first */
+	sys_dlist_t list;
+	/* The head request's work item has been submitted */
+	bool dispatched;
+	/* A give arrived while the head request was dispatched, its take may
+	 * have failed just before the give.
+	 */
+	bool missed;
+};
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static struct k_spinlock async_lock;
+static struct async_queue async_queues[LOCKING_INDEX_COUNT];
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static void async_work_handler(struct k_work *work);
+static bool grantable(const lte_t *const entry);
+static int try_take(const lte_t *const entry, locking_id_t id);
+static void enqueue(struct async_queue *queue, struct locking_async *req);
+static void dispatch(struct async_queue *queue);
+
+static int locking_async_init(const struct device *device);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+SYS_INIT(locking_async_init, APPLICATION, CONFIG_LOCKING_INIT_PRIORITY);
+
+int locking_take_async(locking_id_t id, struct locking_async *req,
+		       locking_async_cb_t callback)
+{
+	const struct locking_table_entry *const entry = locking_map(id);
+	struct async_queue *queue;
+	k_spinlock_key_t key;
+	int r;
+
+	if (entry == NULL || req == NULL || callback == NULL) {
+		return -EINVAL;
+	} else if (!grantable(entry)) {
+		return -ENOTSUP;
+	}
+
+	queue = &async_queues[locking_table_index(entry)];
+
+	k_work_init(&req->work, async_work_handler);
+	sys_dnode_init(&req->node);
+	req->callback = callback;
+	req->id = id;
+	req->priority = k_thread_priority_get(k_current_get());
+	req->granted = false;
+
+	/* Don't overtake requests that are already waiting */
+	key = k_spin_lock(&async_lock);
+	r = sys_dlist_is_empty(&queue->list) ? 0 : -EBUSY;
+	k_spin_unlock(&async_lock, key);
+
+	if (r == 0) {
+		r = try_take(entry, id);
+	}
+
+	if (r == 0) {
+		req->granted = true;
+	} else if (r == -EBUSY) {
+		/* A give between the try and the enqueue finds no request, so
+		 * the new head is dispatched to try again.
+		 */
+		key = k_spin_lock(&async_lock);
+		enqueue(queue, req);
+		dispatch(queue);
+		k_spin_unlock(&async_lock, key);
+		r = -EINPROGRESS;
+	}
+
+	return r;
+}
+
+int locking_cancel_async(struct locking_async *req)
+{
+	const struct locking_table_entry *entry;
+	struct async_queue *queue;
+	struct k_work_sync sync;
+	k_spinlock_key_t key;
+	int r = 0;
+
+	if (req == NULL) {
+		return -EINVAL;
+	}
+
+	entry = locking_map(req->id);
+	if (entry == NULL) {
+		return -EINVAL;
+	}
+
+	queue = &async_queues[locking_table_index(entry)];
+
+	key = k_spin_lock(&async_lock);
+	if (req->granted) {
+		r = -EALREADY;
+	} else if (sys_dnode_is_linked(&req->node)) {
+		if (sys_dlist_peek_head(&queue->list) == &req->node &&
+		    queue->dispatched) {
+			/* The handler re-checks the node, one that is already
+			 * taking gives the lock back. It is waited for below.
+			 */
+			(void)k_work_cancel(&req->work);
+			queue->dispatched = false;
+		}
+
+		sys_dlist_remove(&req->node);
+
+		/* The next request may be able to take the lock now */
+		dispatch(queue);
+	}
+	k_spin_unlock(&async_lock, key);
+
+	/* The request is only free once its handler has returned, which an
+	 * ISR can't wait for.
+	 */
+	if (r == 0 && k_work_busy_get(&req->work) != 0) {
+		if (k_is_in_isr()) {
+			r = -EBUSY;
+		} else {
+			(void)k_work_cancel_sync(&req->work, &sync);
+		}
+	}
+
+	return r;
+}
+
+void locking_async_given(const lte_t *const entry)
+{
+	struct async_queue *queue = &async_queues[locking_table_index(entry)];
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&async_lock);
+	dispatch(queue);
+	k_spin_unlock(&async_lock, key);
+}
+
+bool locking_async_pending(const lte_t *const entry)
+{
+	struct async_queue *queue = &async_queues[locking_table_index(entry)];
+	k_spinlock_key_t key;
+	bool pending;
+
+	key = k_spin_lock(&async_lock);
+	pending = !sys_dlist_is_empty(&queue->list);
+	k_spin_unlock(&async_lock, key);
+
+	return pending;
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static void async_work_handler(struct k_work *work)
+{
+	struct locking_async *req =
+		CONTAINER_OF(work, struct locking_async, work);
+	const struct locking_table_entry *const entry = locking_map(req->id);
+	struct async_queue *queue;
+	k_spinlock_key_t key;
+	bool head;
+	int r;
+
+	if (entry == NULL) {
+		return;
+	}
+
+	queue = &async_queues[locking_table_index(entry)];
+
+	/* Only the head request is ever dispatched, it may have been
+	 * cancelled since. It stays dispatched while it tries.
+	 */
+	key = k_spin_lock(&async_lock);
+	head = (sys_dlist_peek_head(&queue->list) == &req->node);
+	if (head) {
+		queue->missed = false;
+	}
+	k_spin_unlock(&async_lock, key);
+
+	if (!head) {
+		return;
+	}
+
+	/* Outside the spinlock, the take runs all of its accounting */
+	r = try_take(entry, req->id);
+
+	key = k_spin_lock(&async_lock);
+	head = (sys_dlist_peek_head(&queue->list) == &req->node);
+	if (head) {
+		queue->dispatched = false;
+		if (r == 0) {
+			sys_dlist_remove(&req->node);
+			req->granted = true;
+		}
+
+		/* A semaphore may have units left for the next one, a failed
+		 * try waits for the next give unless it has already happened.
+		 */
+		if (r == 0 || queue->missed) {
+			dispatch(queue);
+		}
+	}
+	k_spin_unlock(&async_lock, key);
+
+	if (!head) {
+		/* Cancelled while taking */
+		if (r == 0) {
+			(void)locking_give_entry(entry, req->id);
+		}
+	} else if (r == 0) {
+		req->callback(req);
+	}
+}
+
+/* Types with a give that locking_async_given() follows, the others would
+ * leave their queue waiting forever.
+ */
+static bool grantable(const lte_t *const entry)
+{
+	switch (entry->type) {
+	case LOCKING_TYPE_MUTEX:
+	case LOCKING_TYPE_SEMAPHORE:
+	case LOCKING_TYPE_TICKET:
+	case LOCKING_TYPE_PI_SEMAPHORE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Must be called without async_lock held */
+static int try_take(const lte_t *const entry, locking_id_t id)
+{
+	struct k_mutex *mutex;
+
+	/* Requests that run on the same work queue thread must not nest on a
+	 * mutex that an earlier request still holds.
+	 */
+	if (entry->type == LOCKING_TYPE_MUTEX) {
+		mutex = (struct k_mutex *)entry->pData;
+		if (mutex->lock_count != 0 && mutex->owner == k_current_get()) {
+			return -EBUSY;
+		}
+	}
+
+	return locking_take_entry(entry, id, K_NO_WAIT);
+}
+
+/* Must be called with async_lock held */
+static void enqueue(struct async_queue *queue, struct locking_async *req)
+{
+	struct locking_async *pending;
+	sys_dnode_t *node;
+
+	SYS_DLIST_FOR_EACH_NODE(&queue->list, node) {
+		pending = CONTAINER_OF(node, struct locking_async, node);
+		if (req->priority < pending->priority) {
+			/* The dispatched head keeps its place */
+			if (node != sys_dlist_peek_head(&queue->list) ||
+			    !queue->dispatched) {
+				sys_dlist_insert(node, &req->node);
+				return;
+			}
+		}
+	}
+
+	sys_dlist_append(&queue->list, &req->node);
+}
+
+/* Must be called with async_lock held */
+static void dispatch(struct async_queue *queue)
+{
+	sys_dnode_t *head;
+
+	if (queue->dispatched) {
+		queue->missed = true;
+		return;
+	}
+
+	head = sys_dlist_peek_head(&queue->list);
+	if (head != NULL) {
+		queue->dispatched = true;
+		(void)k_work_submit(
+			&CONTAINER_OF(head, struct locking_async, node)->work);
+	}
+}
+
+static int locking_async_init(const struct device *device)
+{
+	locking_index_t i;
+
+	ARG_UNUSED(device);
+
+	for (i = 0; i < ARRAY_SIZE(async_queues); i++) {
+		sys_dlist_init(&async_queues[i].list);
+	}
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file locking_barrier.c
+ * @brief Barrier and latch
+ *
+ * A barrier waits on a condition variable, so a phase ends with one
+ * broadcast instead of a give per waiting thread. Each waiting party has a
+ * record on its stack that the end of the phase marks as released (and
+ * broken), so a party that only gets the mutex back after later phases have
+ * ended still sees the result of its own phase.
+ *
+ * A latch is mostly counted down from ISRs, so its count is under a
+ * spinlock and waiters pass a semaphore that stays given once it opens.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+
+#include "locking_barrier.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+struct waiter {
+	sys_snode_t node;
+	bool released;
+	bool broken;
+};
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static void next_phase(struct locking_barrier *barrier, bool broken);
+static k_timeout_t remaining(int64_t end, k_timeout_t timeout);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_barrier_init(struct locking_barrier *barrier, uint8_t parties)
+{
+	k_mutex_init(&barrier->lock);
+	k_condvar_init(&barrier->cond);
+	barrier->parties = parties;
+	barrier->arrived = 0;
+	sys_slist_init(&barrier->waiters);
+}
+
+void locking_barrier_reset(struct locking_barrier *barrier)
+{
+	k_mutex_lock(&barrier->lock, K_FOREVER);
+	next_phase(barrier, true);
+	k_mutex_unlock(&barrier->lock);
+}
+
+int locking_barrier_wait_object(struct locking_barrier *barrier,
+				k_timeout_t timeout)
+{
+	int64_t end = sys_clock_timeout_end_calc(timeout);
+	struct waiter w = { .released = false, .broken = false };
+	int r;
+
+	k_mutex_lock(&barrier->lock, K_FOREVER);
+
+	barrier->arrived++;
+	if (barrier->arrived >= barrier->parties) {
+		next_phase(barrier, false);
+		k_mutex_unlock(&barrier->lock);
+		return 0;
+	}
+
+	sys_slist_append(&barrier->waiters, &w.node);
+	while (!w.released) {
+		r = k_condvar_wait(&barrier->cond, &barrier->lock,
+				   remaining(end, timeout));
+		if (r != 0 && !w.released) {
+			/* Release the parties that did arrive */
+			next_phase(barrier, true);
+			k_mutex_unlock(&barrier->lock);
+			return -EAGAIN;
+		}
+	}
+
+	r = w.broken ? -ECANCELED : 0;
+	k_mutex_unlock(&barrier->lock);
+
+	return r;
+}
+
+void locking_latch_init(struct locking_latch *latch, uint8_t count)
+{
+	k_sem_init(&latch->gate, (count == 0) ? 1 : 0, 1);
+	latch->initial = count;
+	latch->count = count;
+}
+
+void locking_latch_reset(struct locking_latch *latch)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&latch->lock);
+	latch->count = latch->initial;
+	if (latch->count != 0) {
+		k_sem_reset(&latch->gate);
+	}
+	k_spin_unlock(&latch->lock, key);
+}
+
+int locking_latch_countdown_object(struct locking_latch *latch)
+{
+	k_spinlock_key_t key;
+	int r = 0;
+
+	key = k_spin_lock(&latch->lock);
+	if (latch->count == 0) {
+		r = -EALREADY;
+	} else if (--latch->count == 0) {
+		k_sem_give(&latch->gate);
+	}
+	k_spin_unlock(&latch->lock, key);
+
+	return r;
+}
+
+int locking_latch_wait_object(struct locking_latch *latch,
+			      k_timeout_t timeout)
+{
+	k_spinlock_key_t key;
+
+	if (k_sem_take(&latch->gate, timeout) != 0) {
+		return -EAGAIN;
+	}
+
+	/* Open for the next waiter, unless re-armed meanwhile */
+	key = k_spin_lock(&latch->lock);
+	if (latch->count == 0) {
+		k_sem_give(&latch->gate);
+	}
+	k_spin_unlock(&latch->lock, key);
+
+	return 0;
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* Called with the barrier mutex held */
+static void next_phase(struct locking_barrier *barrier, bool broken)
+{
+	struct waiter *w;
+	sys_snode_t *node;
+
+	while ((node = sys_slist_get(&barrier->waiters)) != NULL) {
+		w = CONTAINER_OF(node, struct waiter, node);
+		w->released = true;
+		w->broken = broken;
+	}
+
+	barrier->arrived = 0;
+	k_condvar_broadcast(&barrier->cond);
+}
+
+/* Time left of the original timeout after a wake up */
+static k_timeout_t remaining(int64_t end, k_timeout_t timeout)
+{
+	int64_t ticks;
+
+	if (K_TIMEOUT_EQ(timeout, K_FOREVER)) {
+		return K_FOREVER;
+	}
+
+	ticks = end - k_uptime_ticks();
+
+	return (ticks > 0) ? K_TICKS(ticks) : K_NO_WAIT;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file locking_bench.c
+ * @brief Cost of the lock table as it grows
+ *
+ * Measures the boot time of locking_table_initialise(), the lookup of every
+ * ID up to the largest (the misses of a sparse table included) and of a
+ * sample of the names (a linear search), and reports them with the
+ * footprint of the table. The result is logged once at boot, so that it can
+ * be collected from a test run without the shell, and printed by
+ * "locking bench". locking_bench.py builds this for synthetic tables of
+ * several sizes and makes a summary table from the results.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <logging/log.h>
+LOG_MODULE_DECLARE(locking, CONFIG_LOCKING_LOG_LEVEL);
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <init.h>
+#include <sys/util.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+/* Lookups timed at least, small tables are looked up several times */
+#define MIN_LOOKUPS 4096
+
+/* Names looked up, spread over the table */
+#define NAME_SAMPLES 64
+
+/* Read back by locking_bench.py */
+#define BENCH_FMT                                                              \
+	"bench {\"locks\": %u, \"max_id\": %u, \"init_ns\": %u, "              \
+	"\"map_ns\": %u, \"get_id_ns\": %u, \"objects\": %zu, "                \
+	"\"table\": %zu, \"map\": %zu, \"names\": %zu}"
+
+#define BENCH_ARGS(b)                                                          \
+	(b).locks, (b).max_id, (b).init_ns, (b).map_ns, (b).get_id_ns,         \
+		LOCKING_FOOTPRINT.objects, LOCKING_FOOTPRINT.table,            \
+		LOCKING_FOOTPRINT.map, LOCKING_FOOTPRINT.names
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static uint32_t init_cycles;
+
+/* Keeps the lookups from being optimised away */
+static const void *volatile sink;
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static uint32_t average_ns(uint32_t cycles, uint32_t n);
+static int bench_init(const struct device *device);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+SYS_INIT(bench_init, APPLICATION, 99);
+
+void locking_bench_initialised(uint32_t cycles)
+{
+	init_cycles = cycles;
+}
+
+int locking_bench(struct locking_bench *out)
+{
+	uint32_t ids = (uint32_t)LOCKING_TABLE_MAX_ID + 1;
+	uint32_t rounds = DIV_ROUND_UP(MIN_LOOKUPS, ids);
+	uint32_t start;
+	uint32_t i;
+	uint32_t j;
+#ifdef CONFIG_LOCKING_STRING_NAME
+	uint32_t step = MAX(LOCKING_TABLE_SIZE / NAME_SAMPLES, 1);
+	uint32_t n = 0;
+#endif
+
+	out->locks = LOCKING_TABLE_SIZE;
+	out->max_id = LOCKING_TABLE_MAX_ID;
+	out->init_ns = average_ns(init_cycles, 1);
+
+	start = k_cycle_get_32();
+	for (j = 0; j < rounds; j++) {
+		for (i = 0; i < ids; i++) {
+			sink = locking_map((locking_id_t)i);
+		}
+	}
+	out->map_ns = average_ns(k_cycle_get_32() - start, rounds * ids);
+
+#ifdef CONFIG_LOCKING_STRING_NAME
+	start = k_cycle_get_32();
+	for (i = 0; i < LOCKING_TABLE_SIZE; i += step) {
+		sink = (const void *)(uintptr_t)locking_get_id(
+			locking_entry(i)->name);
+		n++;
+	}
+	out->get_id_ns = average_ns(k_cycle_get_32() - start, n);
+#else
+	out->get_id_ns = 0;
+#endif
+
+	return 0;
+}
+
+#ifdef CONFIG_LOCKING_SHELL
+int locking_show_bench(const struct shell *shell)
+{
+	struct locking_bench bench;
+	int r;
+
+	r = locking_bench(&bench);
+	if (r == 0) {
+		shell_print(shell, BENCH_FMT, BENCH_ARGS(bench));
+	}
+
+	return r;
+}
+#endif
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static uint32_t average_ns(uint32_t cycles, uint32_t n)
+{
+	return (uint32_t)(k_cyc_to_ns_floor64(cycles) / MAX(n, 1));
+}
+
+static int bench_init(const struct device *device)
+{
+	struct locking_bench bench;
+
+	ARG_UNUSED(device);
+
+	if (locking_bench(&bench) == 0) {
+		LOG_INF(BENCH_FMT, BENCH_ARGS(bench));
+	}
+
+	return 0;
+}
@@ -0,0 +1,411 @@
+/**
+ * @file locking_blame.c
+ * @brief Blocked time of each thread on each lock
+ *
+ * A sparse thread x lock matrix: threads get a slot in a small table the
+ * first time they take a lock, and each (slot, lock table index) pair that
+ * is used gets a cell in an open addressed hash table. A take updates one
+ * cell, so the cost does not grow with the number of locks. The slot of a
+ * thread is found through an open addressed map that is at most half full,
+ * as the holder records do. With CONFIG_LOCKING_BLAME_CUSTOM_DATA the slot
+ * is also kept in the thread's custom data, which skips the map.
+ *
+ * A cell is looked for in at most PROBES places, so a take stays O(1) when
+ * the matrix fills up. Takes that find no slot or cell are only counted as
+ * dropped. Zephyr has no thread exit hook, so the slots of threads that
+ * have exited are reclaimed by "locking blame" (a new thread that reuses
+ * the k_thread of an exited one before that inherits its row).
+ * locking_blame_clear() starts again.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/util.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#if defined(CONFIG_THREAD_MAX_NAME_LEN) && CONFIG_THREAD_MAX_NAME_LEN > 10
+#define THREAD_NAME_SIZE CONFIG_THREAD_MAX_NAME_LEN
+#else
+#define THREAD_NAME_SIZE 11
+#endif
+
+#define THREADS CONFIG_LOCKING_BLAME_THREADS
+#define CELLS CONFIG_LOCKING_BLAME_CELLS
+
+/* Thread to slot map */
+#define MAP_SIZE (2 * THREADS)
+
+BUILD_ASSERT((CELLS & (CELLS - 1)) == 0,
+	     "CONFIG_LOCKING_BLAME_CELLS must be a power of two");
+
+/* Cells looked at per take */
+#define PROBES MIN(8, CELLS)
+
+/* Cell of a reclaimed slot, skipped by lookups and reused by inserts */
+#define TOMBSTONE UINT8_MAX
+
+/* Slots are stored plus one so that 0 is an empty cell (and custom data) */
+struct cell {
+	locking_index_t index;
+	uint8_t slot;
+	uint32_t takes;
+	uint32_t contended;
+	uint32_t timeouts;
+	/* Cycles spent waiting for the lock */
+	uint64_t blocked;
+};
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static struct k_spinlock blame_lock;
+static struct k_thread *threads[THREADS];
+static uint8_t map[MAP_SIZE];
+/* Reclaimed slots, then the slots from fresh up that were never used */
+static uint8_t spare[THREADS];
+static uint8_t spares;
+static uint8_t fresh;
+static struct cell cells[CELLS];
+static uint32_t dropped;
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static uint8_t thread_slot(struct k_thread *thread);
+static uint16_t map_home(struct k_thread *thread);
+static uint16_t map_find(struct k_thread *thread);
+static struct cell *find_cell(uint8_t slot, locking_index_t index);
+#ifdef CONFIG_LOCKING_SHELL
+static void map_delete(uint16_t pos);
+static bool dead(struct k_thread *thread);
+static void reclaim(uint8_t slot, struct k_thread *thread);
+static void show_thread(const struct shell *shell, uint8_t slot,
+			struct k_thread *thread);
+static void get_thread_name(struct k_thread *thread, char *buffer,
+			    size_t buffer_size);
+#endif
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_blame_add(const lte_t *const entry, int r, bool contended,
+		       uint32_t blocked)
+{
+	struct cell *cell;
+	k_spinlock_key_t key;
+	uint8_t slot;
+
+	/* Only threads are blamed, an ISR does not wait */
+	if (k_is_in_isr()) {
+		return;
+	}
+
+	key = k_spin_lock(&blame_lock);
+	slot = thread_slot(k_current_get());
+	cell = (slot != 0) ? find_cell(slot, locking_table_index(entry)) : NULL;
+	if (cell == NULL) {
+		dropped++;
+	} else {
+		if (r == 0) {
+			cell->takes++;
+		} else {
+			cell->timeouts++;
+		}
+		if (contended) {
+			cell->contended++;
+		}
+		cell->blocked += blocked;
+	}
+	k_spin_unlock(&blame_lock, key);
+}
+
+void locking_blame_clear(void)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&blame_lock);
+	memset(threads, 0, sizeof(threads));
+	memset(map, 0, sizeof(map));
+	spares = 0;
+	fresh = 0;
+	memset(cells, 0, sizeof(cells));
+	dropped = 0;
+	k_spin_unlock(&blame_lock, key);
+}
+
+#ifdef CONFIG_LOCKING_SHELL
+int locking_show_blame(const struct shell *shell, const char *thread)
+{
+	char name[THREAD_NAME_SIZE];
+	struct k_thread *t;
+	k_spinlock_key_t key;
+	bool found = false;
+	bool exited;
+	uint32_t n;
+	uint8_t slot;
+
+	for (slot = 1; slot <= THREADS; slot++) {
+		key = k_spin_lock(&blame_lock);
+		t = threads[slot - 1];
+		exited = (t != NULL) && dead(t);
+		k_spin_unlock(&blame_lock, key);
+
+		if (t == NULL) {
+			continue;
+		} else if (exited) {
+			reclaim(slot, t);
+			continue;
+		}
+
+		get_thread_name(t, name, sizeof(name));
+		if (thread == NULL || strcmp(thread, name) == 0 ||
+		    (void *)strtoul(thread, NULL, 0) == t) {
+			show_thread(shell, slot, t);
+			found = true;
+		}
+	}
+
+	key = k_spin_lock(&blame_lock);
+	n = dropped;
+	k_spin_unlock(&blame_lock, key);
+
+	if (n != 0) {
+		shell_print(shell, "%u takes not recorded (tables full)", n);
+	}
+
+	return (found || thread == NULL) ? 0 : -ENOENT;
+}
+#endif
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* Called with the spinlock held, 0 when every slot is in use */
+static uint8_t thread_slot(struct k_thread *thread)
+{
+	uint16_t pos;
+	uint8_t slot;
+
+#ifdef CONFIG_LOCKING_BLAME_CUSTOM_DATA
+	slot = (uint8_t)(uintptr_t)k_thread_custom_data_get();
+	if (slot != 0 && slot <= THREADS && threads[slot - 1] == thread) {
+		return slot;
+	}
+#endif
+
+	pos = map_find(thread);
+	slot = map[pos];
+	if (slot == 0) {
+		if (spares != 0) {
+			slot = spare[--spares];
+		} else if (fresh < THREADS) {
+			slot = ++fresh;
+		} else {
+			return 0;
+		}
+		threads[slot - 1] = thread;
+		map[pos] = slot;
+	}
+
+#ifdef CONFIG_LOCKING_BLAME_CUSTOM_DATA
+	k_thread_custom_data_set((void *)(uintptr_t)slot);
+#endif
+
+	return slot;
+}
+
+/* Position a thread is probed from */
+static uint16_t map_home(struct k_thread *thread)
+{
+	return (((uint32_t)(uintptr_t)thread >> 2) * 0x9E3779B1u) % MAP_SIZE;
+}
+
+/* Called with the spinlock held. Position of the thread in the map, or of
+ * the empty entry where it would go.
+ */
+static uint16_t map_find(struct k_thread *thread)
+{
+	uint16_t pos = map_home(thread);
+
+	while (map[pos] != 0 && threads[map[pos] - 1] != thread) {
+		pos = (pos + 1) % MAP_SIZE;
+	}
+
+	return pos;
+}
+
+/* Called with the spinlock held, NULL when the pair has no cell within
+ * PROBES places of its hash and none is free there.
+ */
+static struct cell *find_cell(uint8_t slot, locking_index_t index)
+{
+	uint32_t h = ((uint32_t)index * 0x9E3779B1u) ^ slot;
+	struct cell *reuse = NULL;
+	struct cell *cell;
+	uint32_t i;
+
+	for (i = 0; i < PROBES; i++) {
+		cell = &cells[(h + i) & (CELLS - 1)];
+		if (cell->slot == slot && cell->index == index) {
+			return cell;
+		} else if (cell->slot == TOMBSTONE && reuse == NULL) {
+			reuse = cell;
+		} else if (cell->slot == 0) {
+			/* The pair would have been placed here */
+			if (reuse == NULL) {
+				reuse = cell;
+			}
+			break;
+		}
+	}
+
+	if (reuse != NULL) {
+		memset(reuse, 0, sizeof(*reuse));
+		reuse->slot = slot;
+		reuse->index = index;
+	}
+
+	return reuse;
+}
+
+#ifdef CONFIG_LOCKING_SHELL
+/* Called with the spinlock held. Entries after the deleted one are moved
+ * back unless that would put them before their home position.
+ */
+static void map_delete(uint16_t pos)
+{
+	uint16_t j = pos;
+	uint16_t home;
+
+	while (true) {
+		j = (j + 1) % MAP_SIZE;
+		if (map[j] == 0) {
+			break;
+		}
+
+		/* Stays if its home is cyclically in (pos, j] */
+		home = map_home(threads[map[j] - 1]);
+		if ((pos < j) ? (pos < home && home <= j) :
+				(pos < home || home <= j)) {
+			continue;
+		}
+
+		map[pos] = map[j];
+		map[j] = 0;
+		pos = j;
+	}
+
+	map[pos] = 0;
+}
+
+static bool dead(struct k_thread *thread)
+{
+	return (thread->base.thread_state & _THREAD_DEAD) != 0;
+}
+
+/* Free the slot of an exited thread, its cells become tombstones. The
+ * spinlock is taken per cell, as when showing a thread.
+ */
+static void reclaim(uint8_t slot, struct k_thread *thread)
+{
+	k_spinlock_key_t key;
+	uint32_t i;
+
+	for (i = 0; i < CELLS; i++) {
+		key = k_spin_lock(&blame_lock);
+		if (cells[i].slot == slot) {
+			cells[i].slot = TOMBSTONE;
+		}
+		k_spin_unlock(&blame_lock, key);
+	}
+
+	key = k_spin_lock(&blame_lock);
+	if (threads[slot - 1] == thread) {
+		map_delete(map_find(thread));
+		threads[slot - 1] = NULL;
+		spare[spares++] = slot;
+	}
+	k_spin_unlock(&blame_lock, key);
+}
+
+static void show_thread(const struct shell *shell, uint8_t slot,
+			struct k_thread *thread)
+{
+	char name[THREAD_NAME_SIZE];
+	const lte_t *entry;
+	struct cell cell;
+	k_spinlock_key_t key;
+	uint64_t blocked = 0;
+	uint32_t i;
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+	k_thread_runtime_stats_t stats;
+#endif
+
+	get_thread_name(thread, name, sizeof(name));
+	shell_print(shell, "%s", name);
+
+	for (i = 0; i < CELLS; i++) {
+		key = k_spin_lock(&blame_lock);
+		cell = cells[i];
+		k_spin_unlock(&blame_lock, key);
+
+		if (cell.slot != slot) {
+			continue;
+		}
+
+		blocked += cell.blocked;
+		entry = locking_entry(cell.index);
+		/* Runtime lock deleted since */
+		if (entry->type == LOCKING_TYPE_UNKNOWN) {
+			continue;
+		}
+
+		shell_print(shell,
+			    "      " CONFIG_LOCKING_SHOW_FMT ": takes %u "
+			    "contended %u timeouts %u blocked %llu us",
+			    entry->id, entry->name, cell.takes, cell.contended,
+			    cell.timeouts, k_cyc_to_us_floor64(cell.blocked));
+	}
+
+	/* A thread does not run while it is blocked, so the blocked time is
+	 * not part of its CPU time.
+	 */
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+	if (k_thread_runtime_stats_get(thread, &stats) == 0) {
+		shell_print(shell, "      blocked %llu us, cpu %llu us",
+			    k_cyc_to_us_floor64(blocked),
+			    k_cyc_to_us_floor64(stats.execution_cycles));
+		return;
+	}
+#endif
+	shell_print(shell, "      blocked %llu us", k_cyc_to_us_floor64(blocked));
+}
+
+static void get_thread_name(struct k_thread *thread, char *buffer,
+			    size_t buffer_size)
+{
+	const char *name = k_thread_name_get(thread);
+
+	if (name == NULL || name[0] == 0) {
+		snprintk(buffer, buffer_size, "%p", thread);
+	} else {
+		strncpy(buffer, name, buffer_size);
+		buffer[buffer_size - 1] = 0;
+	}
+}
+#endif
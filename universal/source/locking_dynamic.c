@@ -0,0 +1,313 @@
+/**
+ * @file locking_dynamic.c
+ * @brief Locks created at runtime
+ *
+ * Lock objects come from a fixed slab, each slot has a table entry that is
+ * indexed after the generated table. IDs are allocated above the generated
+ * range as base + (generation * count) + slot, so mapping an ID is a
+ * division and a compare, and an ID kept after its lock was destroyed no
+ * longer maps (until the generation counter wraps).
+ *
+ * Mapping is lock-free, so a lock can be destroyed between a caller mapping
+ * its ID and using the object. Takes and gives pin the slot for as long as
+ * they use the object, and destroy only frees a slot that nobody has pinned.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <init.h>
+#include <string.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define SLOTS CONFIG_LOCKING_DYNAMIC_COUNT
+
+/* First dynamic ID */
+#define BASE_ID (LOCKING_TABLE_MAX_ID + 1)
+
+/* IDs wrap before reaching LOCKING_INVALID_ID */
+#define GENERATIONS ((LOCKING_INVALID_ID - BASE_ID) / SLOTS)
+
+BUILD_ASSERT(GENERATIONS >= 2, "Too many dynamic locks for the ID range");
+
+/* Set in the pin count while a slot is being destroyed */
+#define CLOSING 0x40000000
+
+#ifdef CONFIG_LOCKING_STRING_NAME
+#define NAME_SIZE CONFIG_LOCKING_DYNAMIC_NAME_SIZE
+#else
+#define NAME_SIZE 1
+#endif
+
+struct slot {
+	union {
+		struct k_mutex mutex;
+		struct k_sem sem;
+#ifdef CONFIG_LOCKING_TICKET
+		struct locking_ticket ticket;
+#endif
+#ifdef CONFIG_LOCKING_COMBINING
+		struct locking_combining combining;
+#endif
+	} lock;
+#ifdef CONFIG_LOCKING_STATS
+	struct locking_stats stats;
+#endif
+	char name[NAME_SIZE];
+} __aligned(4);
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static struct slot slots[SLOTS];
+static struct k_mem_slab slab;
+static struct k_spinlock dynamic_lock;
+
+/* Unused entries have an invalid ID */
+static struct locking_table_entry entries[SLOTS];
+static uint16_t generation[SLOTS];
+/* Takes and gives using the lock object of each slot */
+static atomic_t users[SLOTS];
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static bool idle(const lte_t *const entry);
+static int locking_dynamic_init(const struct device *device);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+SYS_INIT(locking_dynamic_init, APPLICATION, CONFIG_LOCKING_INIT_PRIORITY);
+
+locking_id_t locking_create(enum locking_type type, uint8_t count,
+			    uint8_t limit, const char *name)
+{
+	struct locking_table_entry *entry;
+	k_spinlock_key_t key;
+	struct slot *slot;
+	locking_id_t id;
+	size_t i;
+
+	if (type == LOCKING_TYPE_SEMAPHORE && (limit < 1 || count > limit)) {
+		return LOCKING_INVALID_ID;
+	} else if (type != LOCKING_TYPE_MUTEX &&
+		   type != LOCKING_TYPE_SEMAPHORE &&
+		   !(IS_ENABLED(CONFIG_LOCKING_TICKET) &&
+		     type == LOCKING_TYPE_TICKET) &&
+		   !(IS_ENABLED(CONFIG_LOCKING_COMBINING) &&
+		     type == LOCKING_TYPE_COMBINING)) {
+		return LOCKING_INVALID_ID;
+	}
+
+	if (k_mem_slab_alloc(&slab, (void **)&slot, K_NO_WAIT) != 0) {
+		return LOCKING_INVALID_ID;
+	}
+	i = slot - slots;
+	entry = &entries[i];
+
+	if (type == LOCKING_TYPE_MUTEX) {
+		k_mutex_init(&slot->lock.mutex);
+	} else if (type == LOCKING_TYPE_SEMAPHORE) {
+		k_sem_init(&slot->lock.sem, count, limit);
+#ifdef CONFIG_LOCKING_TICKET
+	} else if (type == LOCKING_TYPE_TICKET) {
+		/* count is the bypass allowance of a ticket lock */
+		locking_ticket_init(&slot->lock.ticket, count);
+#endif
+#ifdef CONFIG_LOCKING_COMBINING
+	} else if (type == LOCKING_TYPE_COMBINING) {
+		locking_combining_init(&slot->lock.combining);
+#endif
+	}
+
+#ifdef CONFIG_LOCKING_STATS
+	memset(&slot->stats, 0, sizeof(slot->stats));
+	entry->stats = &slot->stats;
+#endif
+	strncpy(slot->name, (name == NULL) ? "" : name, NAME_SIZE - 1);
+	slot->name[NAME_SIZE - 1] = 0;
+
+	entry->name = slot->name;
+	entry->pData = &slot->lock;
+	entry->type = type;
+	entry->count = count;
+	entry->limit = limit;
+	entry->instrument = LOCKING_INSTRUMENT_TRACE;
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	locking_instrument_reset(entry);
+#endif
+
+	/* The ID is written last, it is what makes the entry mappable. The
+	 * release pairs with the acquire in locking_dynamic_map() so that a
+	 * reader that sees the ID also sees the fields above.
+	 */
+	key = k_spin_lock(&dynamic_lock);
+	id = BASE_ID + (generation[i] * SLOTS) + i;
+	__atomic_store_n(&entry->id, id, __ATOMIC_RELEASE);
+	k_spin_unlock(&dynamic_lock, key);
+
+	return id;
+}
+
+int locking_destroy(locking_id_t id)
+{
+	struct locking_table_entry *entry;
+	k_spinlock_key_t key;
+	void *block;
+	size_t i;
+
+	if (locking_dynamic_map(id) == NULL) {
+		return -EINVAL;
+	}
+
+	i = (id - BASE_ID) % SLOTS;
+	entry = &entries[i];
+
+	key = k_spin_lock(&dynamic_lock);
+	if (entry->id != id) {
+		k_spin_unlock(&dynamic_lock, key);
+		return -EINVAL;
+	}
+
+	/* New pins wait from here on, existing ones keep the lock alive */
+	if (!atomic_cas(&users[i], 0, CLOSING)) {
+		k_spin_unlock(&dynamic_lock, key);
+		return -EBUSY;
+	} else if (!idle(entry)) {
+		atomic_set(&users[i], 0);
+		k_spin_unlock(&dynamic_lock, key);
+		return -EBUSY;
+	}
+
+	entry->id = LOCKING_INVALID_ID;
+	entry->type = LOCKING_TYPE_UNKNOWN;
+	generation[i] = (generation[i] + 1) % GENERATIONS;
+	/* A late pin of the old ID now fails on the ID check */
+	atomic_set(&users[i], 0);
+	k_spin_unlock(&dynamic_lock, key);
+
+	block = &slots[i];
+	k_mem_slab_free(&slab, &block);
+
+	return 0;
+}
+
+const struct locking_table_entry *const locking_dynamic_map(locking_id_t id)
+{
+	const struct locking_table_entry *entry;
+
+	if (id < BASE_ID || id == LOCKING_INVALID_ID) {
+		return NULL;
+	}
+
+	entry = &entries[(id - BASE_ID) % SLOTS];
+
+	/* Stale IDs (older generations) don't match */
+	return (__atomic_load_n(&entry->id, __ATOMIC_ACQUIRE) == id) ? entry :
+								       NULL;
+}
+
+bool locking_dynamic_get(const struct locking_table_entry *entry,
+			 locking_id_t id)
+{
+	atomic_t *pins;
+	atomic_val_t v;
+
+	if (!PART_OF_ARRAY(entries, entry)) {
+		/* Generated locks are never destroyed */
+		return true;
+	}
+
+	/* Destroy only holds CLOSING inside its spinlock, and clears it whether
+	 * or not the lock was destroyed, so wait it out.
+	 */
+	pins = &users[entry - &entries[0]];
+	do {
+		v = atomic_get(pins);
+	} while ((v & CLOSING) != 0 || !atomic_cas(pins, v, v + 1));
+
+	/* Destroyed (and maybe created again) after it was mapped */
+	if (__atomic_load_n(&entry->id, __ATOMIC_ACQUIRE) != id) {
+		atomic_dec(pins);
+		return false;
+	}
+
+	return true;
+}
+
+void locking_dynamic_put(const struct locking_table_entry *entry)
+{
+	if (PART_OF_ARRAY(entries, entry)) {
+		atomic_dec(&users[entry - &entries[0]]);
+	}
+}
+
+const struct locking_table_entry *locking_dynamic_entry(locking_index_t index)
+{
+	return (index < SLOTS) ? &entries[index] : NULL;
+}
+
+locking_index_t locking_dynamic_index(const struct locking_table_entry *entry)
+{
+	__ASSERT(PART_OF_ARRAY(entries, entry), "Invalid entry");
+	return LOCKING_TABLE_SIZE + (entry - &entries[0]);
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* A lock can only be destroyed when nobody holds or waits for it, for a
+ * semaphore that is when none of its initial units are out.
+ */
+static bool idle(const lte_t *const entry)
+{
+	struct locking_state state;
+
+	locking_snapshot_range(locking_dynamic_index(entry), &state, 1);
+
+	if (state.waiters != 0 || state.lock_count != 0) {
+		return false;
+	} else if (entry->type == LOCKING_TYPE_SEMAPHORE &&
+		   state.free < entry->count) {
+		return false;
+	}
+
+#ifdef CONFIG_LOCKING_ASYNC
+	if (locking_async_pending(entry)) {
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+/******************************************************************************/
+/* SYS INIT                                                                   */
+/******************************************************************************/
+static int locking_dynamic_init(const struct device *device)
+{
+	size_t i;
+
+	ARG_UNUSED(device);
+
+	for (i = 0; i < SLOTS; i++) {
+		entries[i].id = LOCKING_INVALID_ID;
+		entries[i].type = LOCKING_TYPE_UNKNOWN;
+		entries[i].name = "";
+	}
+
+	return k_mem_slab_init(&slab, slots, sizeof(slots[0]), SLOTS);
+}
@@ -0,0 +1,315 @@
+/**
+ * @file locking_holders.c
+ * @brief Records which threads hold the units of each semaphore
+ *
+ * Each semaphore has one record per unit. Records in use are kept in take
+ * order and, per thread, newest first, with a small open addressed map from
+ * each thread to its newest record. A semaphore give carries no token, so it
+ * releases the calling thread's newest record, falling back to the oldest
+ * record when the unit is given on behalf of another thread or from an ISR.
+ * Units taken from an ISR are recorded without a thread. Adding and
+ * releasing a record are O(1), the map is at most half full so a lookup
+ * only probes a few entries.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+/* Records are numbered from 1, 0 is none */
+#define REC(h, r) (&(h)->holder[(r)-1])
+#define LNK(h, r) (&(h)->links[(r)-1])
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static uint16_t map_home(struct locking_holders *holders,
+			 struct k_thread *thread);
+static uint16_t map_find(struct locking_holders *holders,
+			 struct k_thread *thread);
+static void map_delete(struct locking_holders *holders, uint16_t pos);
+static void chain_push(struct locking_holders *holders, uint8_t r);
+static void chain_unlink(struct locking_holders *holders, uint8_t r);
+static uint8_t record_alloc(struct locking_holders *holders);
+static void record_release(struct locking_holders *holders, uint8_t r);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_holders_add(const lte_t *const entry, void *call_site)
+{
+	struct locking_holders *holders = entry->holders;
+	k_spinlock_key_t key;
+	uint8_t r;
+
+	if (holders == NULL) {
+		return;
+	}
+
+	key = k_spin_lock(&holders->lock);
+	r = record_alloc(holders);
+	if (r == 0) {
+		/* More units are out than the limit allows for, the semaphore
+		 * was given without being taken through this module.
+		 */
+		holders->untracked++;
+		k_spin_unlock(&holders->lock, key);
+		return;
+	}
+
+	/* An ISR would find the interrupted thread */
+	REC(holders, r)->thread = k_is_in_isr() ? NULL : k_current_get();
+	REC(holders, r)->since = k_uptime_get_32();
+	REC(holders, r)->call_site = call_site;
+
+	LNK(holders, r)->prev = holders->last;
+	LNK(holders, r)->next = 0;
+	if (holders->last != 0) {
+		LNK(holders, holders->last)->next = r;
+	} else {
+		holders->first = r;
+	}
+	holders->last = r;
+
+	chain_push(holders, r);
+	k_spin_unlock(&holders->lock, key);
+}
+
+void locking_holders_remove(const lte_t *const entry)
+{
+	struct locking_holders *holders = entry->holders;
+	k_spinlock_key_t key;
+	uint8_t r;
+
+	if (holders == NULL) {
+		return;
+	}
+
+	key = k_spin_lock(&holders->lock);
+	r = k_is_in_isr() ? 0 : holders->map[map_find(holders, k_current_get())];
+	if (r != 0) {
+		record_release(holders, r);
+	} else if (holders->untracked > 0) {
+		/* Released by another context, account for an untracked unit
+		 * first, then blame the longest held unit.
+		 */
+		holders->untracked--;
+	} else if (holders->first != 0) {
+		record_release(holders, holders->first);
+	}
+	k_spin_unlock(&holders->lock, key);
+}
+
+#ifdef CONFIG_LOCKING_HANDOFF
+int locking_holders_handoff(const lte_t *const entry, struct k_thread *to,
+			    void *call_site)
+{
+	struct locking_holders *holders = entry->holders;
+	k_spinlock_key_t key;
+	uint8_t r;
+
+	if (holders == NULL) {
+		return -ENOTSUP;
+	}
+
+	key = k_spin_lock(&holders->lock);
+	r = holders->map[map_find(holders, k_current_get())];
+	if (r != 0) {
+		chain_unlink(holders, r);
+		REC(holders, r)->thread = to;
+		REC(holders, r)->call_site = call_site;
+		chain_push(holders, r);
+	}
+	k_spin_unlock(&holders->lock, key);
+
+	return (r != 0) ? 0 : -ENOENT;
+}
+#endif
+
+void locking_holders_reset(struct locking_holders *holders)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&holders->lock);
+	memset(holders->map, 0, holders->map_size * sizeof(holders->map[0]));
+	holders->first = 0;
+	holders->last = 0;
+	holders->free = 0;
+	holders->fresh = 0;
+	holders->untracked = 0;
+	k_spin_unlock(&holders->lock, key);
+}
+
+int locking_get_holders(locking_id_t id, struct locking_holder *out, size_t n)
+{
+	const struct locking_table_entry *const entry = locking_map(id);
+	struct locking_holders *holders;
+	k_spinlock_key_t key;
+	size_t count = 0;
+	uint8_t r;
+
+	if (entry == NULL || (out == NULL && n != 0)) {
+		return -EINVAL;
+	} else if (entry->holders == NULL) {
+		return -ENOTSUP;
+	}
+
+	holders = entry->holders;
+	key = k_spin_lock(&holders->lock);
+	for (r = holders->first; r != 0 && count < n;
+	     r = LNK(holders, r)->next) {
+		out[count++] = *REC(holders, r);
+	}
+	k_spin_unlock(&holders->lock, key);
+
+	return (int)count;
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* Position a thread is probed from */
+static uint16_t map_home(struct locking_holders *holders,
+			 struct k_thread *thread)
+{
+	return (((uint32_t)(uintptr_t)thread >> 2) * 0x9E3779B1u) %
+	       holders->map_size;
+}
+
+/* Must be called with the holders spinlock held. Position of the thread in
+ * the map, or of the empty entry where it would go.
+ */
+static uint16_t map_find(struct locking_holders *holders,
+			 struct k_thread *thread)
+{
+	uint16_t pos = map_home(holders, thread);
+
+	while (holders->map[pos] != 0 &&
+	       REC(holders, holders->map[pos])->thread != thread) {
+		pos = (pos + 1) % holders->map_size;
+	}
+
+	return pos;
+}
+
+/* Must be called with the holders spinlock held. Entries after the deleted
+ * one are moved back unless that would put them before their home position,
+ * so lookups never stop at a gap.
+ */
+static void map_delete(struct locking_holders *holders, uint16_t pos)
+{
+	uint16_t j = pos;
+	uint16_t home;
+
+	while (true) {
+		j = (j + 1) % holders->map_size;
+		if (holders->map[j] == 0) {
+			break;
+		}
+
+		/* Stays if its home is cyclically in (pos, j] */
+		home = map_home(holders, REC(holders, holders->map[j])->thread);
+		if ((pos < j) ? (pos < home && home <= j) :
+				(pos < home || home <= j)) {
+			continue;
+		}
+
+		holders->map[pos] = holders->map[j];
+		holders->map[j] = 0;
+		pos = j;
+	}
+
+	holders->map[pos] = 0;
+}
+
+/* Must be called with the holders spinlock held, the record becomes the
+ * newest of its thread.
+ */
+static void chain_push(struct locking_holders *holders, uint8_t r)
+{
+	uint16_t pos = map_find(holders, REC(holders, r)->thread);
+	uint8_t newest = holders->map[pos];
+
+	LNK(holders, r)->older = newest;
+	LNK(holders, r)->newer = 0;
+	if (newest != 0) {
+		LNK(holders, newest)->newer = r;
+	}
+	holders->map[pos] = r;
+}
+
+/* Must be called with the holders spinlock held */
+static void chain_unlink(struct locking_holders *holders, uint8_t r)
+{
+	uint8_t older = LNK(holders, r)->older;
+	uint8_t newer = LNK(holders, r)->newer;
+	uint16_t pos;
+
+	if (older != 0) {
+		LNK(holders, older)->newer = newer;
+	}
+
+	if (newer != 0) {
+		LNK(holders, newer)->older = older;
+	} else {
+		/* The thread's newest record, the map moves to the next one */
+		pos = map_find(holders, REC(holders, r)->thread);
+		if (older != 0) {
+			holders->map[pos] = older;
+		} else {
+			map_delete(holders, pos);
+		}
+	}
+}
+
+/* Must be called with the holders spinlock held, 0 if all are in use */
+static uint8_t record_alloc(struct locking_holders *holders)
+{
+	uint8_t r = holders->free;
+
+	if (r != 0) {
+		holders->free = LNK(holders, r)->older;
+	} else if (holders->fresh < holders->size) {
+		r = ++holders->fresh;
+	}
+
+	return r;
+}
+
+/* Must be called with the holders spinlock held */
+static void record_release(struct locking_holders *holders, uint8_t r)
+{
+	uint8_t prev = LNK(holders, r)->prev;
+	uint8_t next = LNK(holders, r)->next;
+
+	chain_unlink(holders, r);
+
+	if (prev != 0) {
+		LNK(holders, prev)->next = next;
+	} else {
+		holders->first = next;
+	}
+	if (next != 0) {
+		LNK(holders, next)->prev = prev;
+	} else {
+		holders->last = prev;
+	}
+
+	LNK(holders, r)->older = holders->free;
+	holders->free = r;
+}
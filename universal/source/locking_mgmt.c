@@ -0,0 +1,180 @@
+/**
+ * @file locking_mgmt.c
+ * @brief mcumgr (SMP) command group returning a CBOR snapshot of all locks
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <init.h>
+#include <mgmt/mgmt.h>
+#include <tinycbor/cbor.h>
+#include <cborattr/cborattr.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking.h"
+#include "locking_mgmt.h"
+
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Number of lock states captured per snapshot pass */
+#define SNAPSHOT_CHUNK 8
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static int snapshot_handler(struct mgmt_ctxt *ctxt);
+static CborError encode_state(CborEncoder *array,
+			      const struct locking_state *state);
+
+static int locking_mgmt_init(const struct device *device);
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static const struct mgmt_handler locking_mgmt_handlers[] = {
+	[LOCKING_MGMT_ID_SNAPSHOT] = {
+		.mh_read = snapshot_handler,
+		.mh_write = NULL,
+	},
+};
+
+static struct mgmt_group locking_mgmt_group = {
+	.mg_handlers = locking_mgmt_handlers,
+	.mg_handlers_count = ARRAY_SIZE(locking_mgmt_handlers),
+	.mg_group_id = CONFIG_LOCKING_MGMT_GROUP_ID,
+};
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+SYS_INIT(locking_mgmt_init, APPLICATION, 99);
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static int snapshot_handler(struct mgmt_ctxt *ctxt)
+{
+	unsigned long long start = 0;
+	unsigned long long count = CONFIG_LOCKING_MGMT_PAGE_SIZE;
+	struct locking_state states[SNAPSHOT_CHUNK];
+	locking_index_t i;
+	locking_index_t end;
+	int captured;
+	int j;
+	CborEncoder array;
+	CborError err = CborNoError;
+
+	const struct cbor_attr_t params[] = {
+		{ .attribute = "start",
+		  .type = CborAttrUnsignedIntegerType,
+		  .addr.uinteger = &start,
+		  .nodefault = true },
+		{ .attribute = "count",
+		  .type = CborAttrUnsignedIntegerType,
+		  .addr.uinteger = &count,
+		  .nodefault = true },
+		{ .attribute = NULL }
+	};
+
+	if (cbor_read_object(&ctxt->it, params) != 0) {
+		return MGMT_ERR_EINVAL;
+	}
+
+	if (start > LOCKING_INDEX_COUNT) {
+		return MGMT_ERR_EINVAL;
+	}
+
+	count = MIN(count, CONFIG_LOCKING_MGMT_PAGE_SIZE);
+	end = (locking_index_t)MIN(start + count, LOCKING_INDEX_COUNT);
+
+	err |= cbor_encode_text_stringz(&ctxt->encoder, "total");
+	err |= cbor_encode_uint(&ctxt->encoder, LOCKING_INDEX_COUNT);
+	err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+	err |= cbor_encode_uint(&ctxt->encoder, end);
+	err |= cbor_encode_text_stringz(&ctxt->encoder, "locks");
+	err |= cbor_encoder_create_array(&ctxt->encoder, &array,
+					 end - (locking_index_t)start);
+
+	i = (locking_index_t)start;
+	while (i < end && err == CborNoError) {
+		captured = locking_snapshot_range(i, states,
+						  MIN(ARRAY_SIZE(states), end - i));
+		for (j = 0; j < captured; j++) {
+			err |= encode_state(&array, &states[j]);
+		}
+		i += captured;
+	}
+
+	err |= cbor_encoder_close_container(&ctxt->encoder, &array);
+
+	return (err == CborNoError) ? MGMT_ERR_EOK : MGMT_ERR_ENOMEM;
+}
+
+static CborError encode_state(CborEncoder *array,
+			      const struct locking_state *state)
+{
+	CborEncoder map;
+	CborError err = CborNoError;
+	uint32_t count;
+#ifdef CONFIG_LOCKING_STATS
+	const lte_t *const entry = locking_entry(state->index);
+	struct locking_stats total;
+	CborEncoder stats;
+#endif
+
+	if (state->type == LOCKING_TYPE_MUTEX) {
+		count = state->lock_count;
+	} else {
+		count = state->free;
+	}
+
+	err |= cbor_encoder_create_map(array, &map, CborIndefiniteLength);
+	err |= cbor_encode_text_stringz(&map, "i");
+	err |= cbor_encode_uint(&map, state->index);
+	err |= cbor_encode_text_stringz(&map, "id");
+	err |= cbor_encode_uint(&map, state->id);
+	err |= cbor_encode_text_stringz(&map, "t");
+	err |= cbor_encode_uint(&map, state->type);
+	err |= cbor_encode_text_stringz(&map, "c");
+	err |= cbor_encode_uint(&map, count);
+	err |= cbor_encode_text_stringz(&map, "w");
+	err |= cbor_encode_uint(&map, state->waiters);
+
+	if (state->owner != NULL) {
+		err |= cbor_encode_text_stringz(&map, "o");
+		err |= cbor_encode_uint(&map, POINTER_TO_UINT(state->owner));
+	}
+
+#ifdef CONFIG_LOCKING_STATS
+	err |= cbor_encode_text_stringz(&map, "s");
+	locking_stats_total(entry, &total);
+	err |= cbor_encoder_create_array(&map, &stats, 4);
+	err |= cbor_encode_uint(&stats, atomic_get(&total.takes));
+	err |= cbor_encode_uint(&stats, atomic_get(&total.gives));
+	err |= cbor_encode_uint(&stats, atomic_get(&total.contended));
+	err |= cbor_encode_uint(&stats, atomic_get(&total.timeouts));
+	err |= cbor_encoder_close_container(&map, &stats);
+#endif
+
+	err |= cbor_encoder_close_container(array, &map);
+
+	return err;
+}
+
+static int locking_mgmt_init(const struct device *device)
+{
+	ARG_UNUSED(device);
+
+	mgmt_register_group(&locking_mgmt_group);
+
+	return 0;
+}
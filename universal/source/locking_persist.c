@@ -0,0 +1,329 @@
+/**
+ * @file locking_persist.c
+ * @brief Lock statistics and events kept in no-init RAM across warm resets
+ *
+ * The region is not cleared at boot. Its header carries a layout version
+ * and a CRC, so after a warm reset (watchdog, fault) a valid region is
+ * copied into the previous boot view before a new one is started. Counters
+ * are copied from the live statistics periodically and by
+ * locking_persist_save(), so they are as old as the last save when the
+ * reset happens, and carry their own CRC. A reset in the middle of a save
+ * loses the counters of that boot. Events are written in place as they
+ * happen, too often for a CRC, so each one ends with its sequence number
+ * and only those that match their place in the ring are kept.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <string.h>
+#include <sys/util.h>
+#include <sys/crc.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define PERSIST_MAGIC 0x4C4B5053
+
+/* Increment when the layout of struct region or its members changes */
+#define PERSIST_VERSION 2
+
+#define EVENTS CONFIG_LOCKING_PERSIST_EVENTS
+
+struct header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t locks;
+	uint32_t size;
+	/* CRC-32 of the fields above */
+	uint32_t crc;
+};
+
+struct persisted_event {
+	struct locking_event event;
+	/* Number of the event plus one, written last */
+	uint32_t sequence;
+};
+
+struct region {
+	struct header header;
+	/* Events recorded, the ring holds the last EVENTS of them */
+	atomic_t recorded;
+	/* CRC-32 of saved and counters */
+	uint32_t counters_crc;
+	/* k_uptime_get_32() when the counters were last saved */
+	uint32_t saved;
+	struct locking_counters counters[LOCKING_INDEX_COUNT];
+	struct persisted_event events[EVENTS];
+};
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static __noinit struct region persisted;
+
+static struct region previous;
+static bool previous_valid;
+static bool previous_counters_valid;
+/* Events of the previous boot that passed their check, oldest first */
+static struct locking_event previous_events[EVENTS];
+static uint32_t previous_event_count;
+
+#if CONFIG_LOCKING_PERSIST_INTERVAL_MS > 0
+static struct k_work_delayable save_work;
+#endif
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static uint32_t header_crc(const struct header *header);
+static uint32_t counters_crc(const struct region *region);
+static bool valid(const struct region *region);
+static void keep_events(const struct region *region);
+#if CONFIG_LOCKING_PERSIST_INTERVAL_MS > 0
+static void save_handler(struct k_work *work);
+#endif
+#ifdef CONFIG_LOCKING_SHELL
+static const char *event_name(uint8_t kind);
+#endif
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_persist_init(void)
+{
+	previous_valid = valid(&persisted);
+	if (previous_valid) {
+		previous = persisted;
+		previous_counters_valid =
+			(previous.counters_crc == counters_crc(&previous));
+		keep_events(&previous);
+	}
+
+	memset(&persisted, 0, sizeof(persisted));
+	persisted.header.magic = PERSIST_MAGIC;
+	persisted.header.version = PERSIST_VERSION;
+	persisted.header.locks = LOCKING_INDEX_COUNT;
+	persisted.header.size = sizeof(persisted);
+	persisted.header.crc = header_crc(&persisted.header);
+
+	locking_persist_save();
+
+#if CONFIG_LOCKING_PERSIST_INTERVAL_MS > 0
+	k_work_init_delayable(&save_work, save_handler);
+	k_work_schedule(&save_work, K_MSEC(CONFIG_LOCKING_PERSIST_INTERVAL_MS));
+#endif
+}
+
+void locking_persist_event(const lte_t *const entry,
+			   enum locking_event_kind kind, int r)
+{
+	uint32_t n = (uint32_t)atomic_inc(&persisted.recorded);
+	struct persisted_event *slot = &persisted.events[n % EVENTS];
+
+	slot->event.time = k_uptime_get_32();
+	slot->event.thread = k_current_get();
+	slot->event.id = entry->id;
+	slot->event.kind = kind;
+	slot->event.result = (int8_t)MAX(r, INT8_MIN);
+	/* A reset before this leaves the old number, which doesn't match */
+	compiler_barrier();
+	slot->sequence = n + 1;
+}
+
+void locking_persist_save(void)
+{
+	struct locking_counters *counters;
+	struct locking_stats total;
+	const lte_t *entry;
+	locking_index_t i;
+
+	for (i = 0; i < LOCKING_INDEX_COUNT; i++) {
+		entry = locking_entry(i);
+		counters = &persisted.counters[i];
+
+		/* Unused runtime lock slots */
+		if (entry->type == LOCKING_TYPE_UNKNOWN) {
+			memset(counters, 0, sizeof(*counters));
+			counters->id = LOCKING_INVALID_ID;
+			continue;
+		}
+
+		locking_stats_total(entry, &total);
+		counters->id = entry->id;
+		counters->takes = atomic_get(&total.takes);
+		counters->gives = atomic_get(&total.gives);
+		counters->contended = atomic_get(&total.contended);
+		counters->timeouts = atomic_get(&total.timeouts);
+	}
+
+	persisted.saved = k_uptime_get_32();
+	persisted.counters_crc = counters_crc(&persisted);
+}
+
+int locking_previous_counters(locking_index_t index,
+			      struct locking_counters *out)
+{
+	if (!previous_valid || !previous_counters_valid) {
+		return -ENODATA;
+	} else if (index >= LOCKING_INDEX_COUNT || out == NULL) {
+		return -EINVAL;
+	}
+
+	*out = previous.counters[index];
+
+	return 0;
+}
+
+int locking_previous_events(struct locking_event *out, size_t n)
+{
+	uint32_t first;
+
+	if (!previous_valid) {
+		return -ENODATA;
+	} else if (out == NULL && n != 0) {
+		return -EINVAL;
+	}
+
+	n = MIN(n, previous_event_count);
+	first = previous_event_count - n;
+	memcpy(out, &previous_events[first], n * sizeof(out[0]));
+
+	return (int)n;
+}
+
+#ifdef CONFIG_LOCKING_SHELL
+int locking_show_previous(const struct shell *shell)
+{
+	struct locking_counters *counters;
+	struct locking_event *event;
+	uint32_t i;
+
+	if (!previous_valid) {
+		return -ENODATA;
+	}
+
+	if (previous_counters_valid) {
+		shell_print(shell,
+			    "Counters saved at %u ms, last %u of %u events",
+			    previous.saved, previous_event_count,
+			    (uint32_t)atomic_get(&previous.recorded));
+	} else {
+		shell_print(shell, "Counters corrupted, last %u of %u events",
+			    previous_event_count,
+			    (uint32_t)atomic_get(&previous.recorded));
+	}
+
+	/* IDs are those of the previous boot, names are from this build */
+	for (i = 0; previous_counters_valid && i < LOCKING_INDEX_COUNT; i++) {
+		counters = &previous.counters[i];
+		if (counters->id == LOCKING_INVALID_ID || counters->takes == 0) {
+			continue;
+		}
+
+		shell_print(shell,
+			    CONFIG_LOCKING_SHOW_FMT
+			    ": takes %u gives %u contended %u timeouts %u",
+			    counters->id, locking_get_name(counters->id),
+			    counters->takes, counters->gives,
+			    counters->contended, counters->timeouts);
+	}
+
+	for (i = 0; i < previous_event_count; i++) {
+		event = &previous_events[i];
+		shell_print(shell, "      %u ms %s %u by %p (%d)", event->time,
+			    event_name(event->kind), event->id, event->thread,
+			    event->result);
+	}
+
+	return 0;
+}
+#endif
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static uint32_t header_crc(const struct header *header)
+{
+	return crc32_ieee((const uint8_t *)header,
+			  offsetof(struct header, crc));
+}
+
+static uint32_t counters_crc(const struct region *region)
+{
+	uint32_t crc;
+
+	crc = crc32_ieee((const uint8_t *)&region->saved,
+			 sizeof(region->saved));
+	return crc32_ieee_update(crc, (const uint8_t *)region->counters,
+				 sizeof(region->counters));
+}
+
+/* RAM is random after a cold boot, the magic and CRC reject it */
+static bool valid(const struct region *region)
+{
+	const struct header *header = &region->header;
+
+	return header->magic == PERSIST_MAGIC &&
+	       header->version == PERSIST_VERSION &&
+	       header->locks == LOCKING_INDEX_COUNT &&
+	       header->size == sizeof(*region) &&
+	       header->crc == header_crc(header);
+}
+
+/* Events whose sequence number doesn't match their place in the ring were
+ * torn by the reset or are left from an older boot.
+ */
+static void keep_events(const struct region *region)
+{
+	uint32_t recorded = (uint32_t)atomic_get(&region->recorded);
+	const struct persisted_event *slot;
+	uint32_t n;
+
+	previous_event_count = 0;
+	for (n = recorded - MIN(recorded, EVENTS); n != recorded; n++) {
+		slot = &region->events[n % EVENTS];
+		if (slot->sequence == n + 1 &&
+		    slot->event.kind <= LOCKING_EVENT_HANDOFF) {
+			previous_events[previous_event_count++] = slot->event;
+		}
+	}
+}
+
+#if CONFIG_LOCKING_PERSIST_INTERVAL_MS > 0
+static void save_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	locking_persist_save();
+	k_work_schedule(&save_work, K_MSEC(CONFIG_LOCKING_PERSIST_INTERVAL_MS));
+}
+#endif
+
+#ifdef CONFIG_LOCKING_SHELL
+static const char *event_name(uint8_t kind)
+{
+	switch (kind) {
+	case LOCKING_EVENT_TAKE:
+		return "take";
+	case LOCKING_EVENT_TAKE_FAILED:
+		return "take failed";
+	case LOCKING_EVENT_GIVE:
+		return "give";
+	case LOCKING_EVENT_HANDOFF:
+		return "handoff";
+	default:
+		return "?";
+	}
+}
+#endif
@@ -0,0 +1,274 @@
+/**
+ * @file locking_pi_sem.c
+ * @brief Priority inheriting binary semaphore
+ *
+ * A k_mutex inherits priority but must be unlocked by its owner, a k_sem
+ * can be given by anyone but inherits nothing. This semaphore records the
+ * thread that took it (the logical holder) and a list of the threads
+ * waiting, and raises the holder to the priority of the highest waiter
+ * until the semaphore is given, by any thread or ISR. A waiter that times
+ * out lowers the holder again.
+ *
+ * Priorities are only changed with the spinlock held, so the holder can't
+ * be given (and its priority restored) between deciding on a change and
+ * making it. The scheduler is locked around the spinlock so that a change
+ * doesn't reschedule with it held, any preemption happens when the
+ * scheduler is unlocked. The scheduler does not allow priority changes from
+ * an ISR, so a give from an ISR leaves the holder's priority to the system
+ * work queue or the next take, whichever comes first.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <sys/util.h>
+
+#include "locking_pi_sem.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+struct waiter {
+	sys_dnode_t node;
+	int prio;
+};
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static k_spinlock_key_t lock(struct locking_pi_sem *pi);
+static void unlock(struct locking_pi_sem *pi, k_spinlock_key_t key);
+static void claim(struct locking_pi_sem *pi);
+static int inherited(struct locking_pi_sem *pi);
+static void update(struct locking_pi_sem *pi);
+static void restore_pending(struct locking_pi_sem *pi);
+static void set_priority(struct k_thread *thread, int prio);
+static void restore_handler(struct k_work *work);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_pi_sem_init(struct locking_pi_sem *pi)
+{
+	k_sem_init(&pi->sem, 1, 1);
+	pi->held = false;
+	pi->holder = NULL;
+	pi->base_prio = 0;
+	sys_dlist_init(&pi->waiters);
+	k_work_init(&pi->restore, restore_handler);
+	pi->restore_thread = NULL;
+	pi->restore_prio = 0;
+	pi->boosts = 0;
+}
+
+void locking_pi_sem_reset(struct locking_pi_sem *pi)
+{
+	(void)locking_pi_sem_give(pi);
+}
+
+int locking_pi_sem_take(struct locking_pi_sem *pi, k_timeout_t wait_time)
+{
+	struct waiter waiter;
+	k_spinlock_key_t key;
+	int r;
+
+	r = k_sem_take(&pi->sem, K_NO_WAIT);
+	if (r == 0) {
+		claim(pi);
+		return 0;
+	} else if (K_TIMEOUT_EQ(wait_time, K_NO_WAIT)) {
+		return r;
+	}
+
+	waiter.prio = k_thread_priority_get(k_current_get());
+
+	key = lock(pi);
+	sys_dlist_append(&pi->waiters, &waiter.node);
+	if (pi->holder != NULL &&
+	    inherited(pi) < k_thread_priority_get(pi->holder)) {
+		pi->boosts++;
+	}
+	update(pi);
+	unlock(pi, key);
+
+	r = k_sem_take(&pi->sem, wait_time);
+
+	/* On a timeout the holder (whichever thread it is by now) no longer
+	 * inherits this thread's priority.
+	 */
+	key = lock(pi);
+	sys_dlist_remove(&waiter.node);
+	update(pi);
+	unlock(pi, key);
+
+	if (r == 0) {
+		claim(pi);
+	}
+
+	return r;
+}
+
+int locking_pi_sem_give(struct locking_pi_sem *pi)
+{
+	bool deferred = false;
+	k_spinlock_key_t key;
+
+	key = lock(pi);
+	if (!pi->held) {
+		unlock(pi, key);
+		return -EALREADY;
+	}
+
+	if (k_is_in_isr()) {
+		if (pi->holder != NULL) {
+			/* The take by this holder restored any earlier one */
+			__ASSERT_NO_MSG(pi->restore_thread == NULL);
+			pi->restore_thread = pi->holder;
+			pi->restore_prio = pi->base_prio;
+			deferred = true;
+		}
+	} else {
+		set_priority(pi->holder, pi->base_prio);
+	}
+	pi->held = false;
+	pi->holder = NULL;
+	unlock(pi, key);
+
+	if (deferred) {
+		k_work_submit(&pi->restore);
+	}
+
+	k_sem_give(&pi->sem);
+
+	return 0;
+}
+
+int locking_pi_sem_handoff(struct locking_pi_sem *pi, struct k_thread *to)
+{
+	struct k_thread *from = k_current_get();
+	k_spinlock_key_t key;
+	int from_prio;
+
+	key = lock(pi);
+	if (!pi->held) {
+		unlock(pi, key);
+		return -EALREADY;
+	} else if (pi->holder != from) {
+		unlock(pi, key);
+		return -EPERM;
+	} else if (to->base.pended_on == &pi->sem.wait_q) {
+		unlock(pi, key);
+		return -EBUSY;
+	}
+
+	restore_pending(pi);
+	from_prio = pi->base_prio;
+	pi->holder = to;
+	pi->base_prio = k_thread_priority_get(to);
+
+	/* Raise the new holder first so that the waiters are never left
+	 * behind a lower priority thread.
+	 */
+	update(pi);
+	set_priority(from, from_prio);
+	unlock(pi, key);
+
+	return 0;
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* The scheduler can't be locked from an ISR, which never changes priorities */
+static k_spinlock_key_t lock(struct locking_pi_sem *pi)
+{
+	if (!k_is_in_isr()) {
+		k_sched_lock();
+	}
+
+	return k_spin_lock(&pi->lock);
+}
+
+static void unlock(struct locking_pi_sem *pi, k_spinlock_key_t key)
+{
+	k_spin_unlock(&pi->lock, key);
+
+	if (!k_is_in_isr()) {
+		k_sched_unlock();
+	}
+}
+
+/* Record the caller as holder, it inherits from the threads still waiting */
+static void claim(struct locking_pi_sem *pi)
+{
+	struct k_thread *thread = k_is_in_isr() ? NULL : k_current_get();
+	k_spinlock_key_t key;
+
+	key = lock(pi);
+	pi->held = true;
+	pi->holder = thread;
+	if (thread != NULL) {
+		/* Before reading the base priority, the caller may be the
+		 * holder of an earlier hold given by an ISR.
+		 */
+		restore_pending(pi);
+		pi->base_prio = k_thread_priority_get(thread);
+		update(pi);
+	}
+	unlock(pi, key);
+}
+
+/* Priority the holder should run at, lower values are higher priorities.
+ * Called with the spinlock held.
+ */
+static int inherited(struct locking_pi_sem *pi)
+{
+	struct waiter *waiter;
+	int prio = pi->base_prio;
+
+	SYS_DLIST_FOR_EACH_CONTAINER (&pi->waiters, waiter, node) {
+		prio = MIN(prio, waiter->prio);
+	}
+
+	return prio;
+}
+
+/* Set the holder to the priority it inherits. Called with the spinlock held
+ * from a thread.
+ */
+static void update(struct locking_pi_sem *pi)
+{
+	set_priority(pi->holder, inherited(pi));
+}
+
+/* Lower the holder of a hold given by an ISR. Called with the spinlock held
+ * from a thread.
+ */
+static void restore_pending(struct locking_pi_sem *pi)
+{
+	set_priority(pi->restore_thread, pi->restore_prio);
+	pi->restore_thread = NULL;
+}
+
+static void set_priority(struct k_thread *thread, int prio)
+{
+	if (thread != NULL && k_thread_priority_get(thread) != prio) {
+		k_thread_priority_set(thread, prio);
+	}
+}
+
+static void restore_handler(struct k_work *work)
+{
+	struct locking_pi_sem *pi =
+		CONTAINER_OF(work, struct locking_pi_sem, restore);
+	k_spinlock_key_t key;
+
+	key = lock(pi);
+	restore_pending(pi);
+	unlock(pi, key);
+}
@@ -0,0 +1,150 @@
+/**
+ * @file locking_pool.c
+ * @brief Resource pool lock
+ *
+ * The semaphore counts free slots and the bitmap says which ones they are.
+ * A unit from the semaphore guarantees that a bit is set, the taker claims
+ * the lowest one with an atomic test and clear, retrying only if another
+ * taker claimed the same bit first. A give sets the bit with an atomic test
+ * and set before returning the unit, so a slot given twice is caught without
+ * corrupting the count.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <logging/log.h>
+LOG_MODULE_DECLARE(locking, CONFIG_LOCKING_LOG_LEVEL);
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <sys/atomic.h>
+
+#include "locking_pool.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define WORDS(p) (((p)->size + ATOMIC_BITS - 1) / ATOMIC_BITS)
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static uint16_t claim(struct locking_pool *pool);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_pool_init(struct locking_pool *pool, atomic_t *map,
+		       struct k_thread **owner, uint16_t size)
+{
+	pool->map = map;
+	pool->owner = owner;
+	pool->size = size;
+	k_sem_init(&pool->sem, size, size);
+	locking_pool_reset(pool);
+}
+
+void locking_pool_reset(struct locking_pool *pool)
+{
+	uint16_t i;
+
+	for (i = 0; i < pool->size; i++) {
+		atomic_set_bit(pool->map, i);
+		if (pool->owner != NULL) {
+			pool->owner[i] = NULL;
+		}
+	}
+
+	/* k_sem_reset empties the semaphore, give back every unit */
+	k_sem_reset(&pool->sem);
+	for (i = 0; i < pool->size; i++) {
+		k_sem_give(&pool->sem);
+	}
+}
+
+int locking_pool_take(struct locking_pool *pool, k_timeout_t wait_time,
+		      uint16_t *slot)
+{
+	int r;
+
+	r = k_sem_take(&pool->sem, wait_time);
+	if (r != 0) {
+		return r;
+	}
+
+	*slot = claim(pool);
+	if (pool->owner != NULL) {
+		pool->owner[*slot] = k_current_get();
+	}
+
+	return 0;
+}
+
+int locking_pool_give(struct locking_pool *pool, uint16_t slot)
+{
+	if (slot >= pool->size) {
+		return -EINVAL;
+	}
+
+	if (pool->owner != NULL) {
+		if (!atomic_test_bit(pool->map, slot) &&
+		    pool->owner[slot] != k_current_get()) {
+			LOG_ERR("Pool slot %u given by %p, held by %p", slot,
+				k_current_get(), pool->owner[slot]);
+			return -EPERM;
+		}
+		pool->owner[slot] = NULL;
+	}
+
+	if (atomic_test_and_set_bit(pool->map, slot)) {
+		LOG_ERR("Pool slot %u given twice", slot);
+		return -EALREADY;
+	}
+
+	k_sem_give(&pool->sem);
+
+	return 0;
+}
+
+bool locking_pool_slot_used(struct locking_pool *pool, uint16_t slot,
+			    struct k_thread **owner)
+{
+	bool used = (slot < pool->size) && !atomic_test_bit(pool->map, slot);
+
+	if (owner != NULL) {
+		*owner = (used && pool->owner != NULL) ? pool->owner[slot] :
+							 NULL;
+	}
+
+	return used;
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* The caller holds a unit, so at least one bit is set for it */
+static uint16_t claim(struct locking_pool *pool)
+{
+	atomic_val_t free;
+	uint16_t w;
+	int bit;
+
+	while (true) {
+		for (w = 0; w < WORDS(pool); w++) {
+			free = atomic_get(&pool->map[w]);
+			while (free != 0) {
+				bit = __builtin_ctzl((unsigned long)free);
+				if (atomic_test_and_clear_bit(
+					    pool->map, (w * ATOMIC_BITS) + bit)) {
+					return (w * ATOMIC_BITS) + bit;
+				}
+				/* Claimed by a concurrent taker */
+				free &= ~((atomic_val_t)1 << bit);
+			}
+		}
+	}
+}
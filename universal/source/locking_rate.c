@@ -0,0 +1,122 @@
+/**
+ * @file locking_rate.c
+ * @brief Rate lock
+ *
+ * A token bucket kept as the time at which it is full again (generic cell
+ * rate algorithm). A take moves that time one token interval forward and
+ * succeeds at once if it stays within burst - 1 intervals of now. Nothing
+ * runs between takes, the elapsed time is the refill. A take that has to
+ * wait reserves its token first, so it sleeps exactly until it is due and
+ * later takes queue behind it.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <sys/util.h>
+
+#include "locking_rate.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+/* One token in units of 1/rate ticks */
+#define INTERVAL ((uint64_t)CONFIG_SYS_CLOCK_TICKS_PER_SEC)
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static uint64_t now_units(struct locking_rate *rate, int64_t ticks);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_rate_init(struct locking_rate *rate, uint32_t per_sec,
+		       uint8_t burst)
+{
+	rate->rate = MAX(per_sec, 1);
+	rate->burst = MAX(burst, 1);
+	rate->tolerance = (rate->burst - 1) * INTERVAL;
+	atomic_set(&rate->waiting, 0);
+	locking_rate_reset(rate);
+}
+
+void locking_rate_reset(struct locking_rate *rate)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&rate->lock);
+	rate->tat = 0;
+	k_spin_unlock(&rate->lock, key);
+}
+
+int locking_rate_take(struct locking_rate *rate, k_timeout_t wait_time)
+{
+	int64_t ticks = k_uptime_ticks();
+	int64_t end = sys_clock_timeout_end_calc(wait_time);
+	uint64_t now = now_units(rate, ticks);
+	int64_t due_ticks = 0;
+	k_spinlock_key_t key;
+	uint64_t tat;
+	uint64_t due;
+
+	key = k_spin_lock(&rate->lock);
+	tat = MAX(rate->tat, now);
+	due = tat - MIN(tat, rate->tolerance);
+	if (due > now) {
+		due_ticks = (int64_t)DIV_ROUND_UP(due, rate->rate);
+		if (K_TIMEOUT_EQ(wait_time, K_NO_WAIT)) {
+			k_spin_unlock(&rate->lock, key);
+			return -EBUSY;
+		} else if (!K_TIMEOUT_EQ(wait_time, K_FOREVER) &&
+			   due_ticks > end) {
+			k_spin_unlock(&rate->lock, key);
+			return -EAGAIN;
+		}
+		atomic_inc(&rate->waiting);
+	}
+	rate->tat = tat + INTERVAL;
+	k_spin_unlock(&rate->lock, key);
+
+	if (due_ticks != 0) {
+		/* The token is reserved, a wake up before it is due sleeps
+		 * again.
+		 */
+		while ((ticks = due_ticks - k_uptime_ticks()) > 0) {
+			k_sleep(K_TICKS(ticks));
+		}
+		atomic_dec(&rate->waiting);
+	}
+
+	return 0;
+}
+
+uint8_t locking_rate_tokens(struct locking_rate *rate)
+{
+	uint64_t now = now_units(rate, k_uptime_ticks());
+	k_spinlock_key_t key;
+	uint64_t backlog;
+
+	key = k_spin_lock(&rate->lock);
+	backlog = (rate->tat > now) ? (rate->tat - now) : 0;
+	k_spin_unlock(&rate->lock, key);
+
+	if (backlog > rate->tolerance + INTERVAL) {
+		return 0;
+	}
+
+	return (uint8_t)((rate->tolerance + INTERVAL - backlog) / INTERVAL);
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static uint64_t now_units(struct locking_rate *rate, int64_t ticks)
+{
+	return (uint64_t)ticks * rate->rate;
+}
@@ -24,11 +24,46 @@
 /******************************************************************************/
 #define DEFAULT_WAIT_TIME_SECONDS 3
 
+#define DEFAULT_STRESS_SECONDS 5
+#define MAX_STRESS_SECONDS 600
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+/* Indexed by enum locking_instrument */
+static const char *const INSTRUMENT_LEVELS[] = { "none", "counters", "timing",
+						 "trace" };
+#endif
+
 /******************************************************************************/
 /* Local Function Prototypes                                                  */
 /******************************************************************************/
 static int ats_show_cmd(const struct shell *shell, size_t argc, char **argv);
 static int ats_get_cmd(const struct shell *shell, size_t argc, char **argv);
+static int ats_memory_cmd(const struct shell *shell, size_t argc, char **argv);
+#ifdef CONFIG_LOCKING_HOLDERS
+static int ats_holders_cmd(const struct shell *shell, size_t argc, char **argv);
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+static int ats_profile_cmd(const struct shell *shell, size_t argc, char **argv);
+#endif
+
+#ifdef CONFIG_LOCKING_BLAME
+static int ats_blame_cmd(const struct shell *shell, size_t argc, char **argv);
+#endif
+
+#ifdef CONFIG_LOCKING_BENCH
+static int ats_bench_cmd(const struct shell *shell, size_t argc, char **argv);
+#endif
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+static int ats_instrument_cmd(const struct shell *shell, size_t argc,
+			      char **argv);
+#endif
+
+#ifdef CONFIG_LOCKING_PERSIST
+static int ats_previous_cmd(const struct shell *shell, size_t argc,
+			    char **argv);
+#endif
 
 #ifdef CONFIG_LOCKING_SHELL_MANIPULATION
 static int ats_take_cmd(const struct shell *shell, size_t argc, char **argv);
@@ -36,6 +71,10 @@ static int ats_give_cmd(const struct shell *shell, size_t argc, char **argv);
 static int ats_reset_cmd(const struct shell *shell, size_t argc, char **argv);
 #endif
 
+#ifdef CONFIG_LOCKING_STRESS
+static int ats_stress_cmd(const struct shell *shell, size_t argc, char **argv);
+#endif
+
 static int locking_shell_init(const struct device *device);
 
 /******************************************************************************/
@@ -45,10 +84,50 @@ SHELL_STATIC_SUBCMD_SET_CREATE(
 	sub_attr,
 	SHELL_CMD(show, NULL, "Display details on all locks", ats_show_cmd),
 	SHELL_CMD(get, NULL, "Get details of a lock", ats_get_cmd),
+	SHELL_CMD(memory, NULL, "Display RAM used by lock objects",
+		  ats_memory_cmd),
+#ifdef CONFIG_LOCKING_HOLDERS
+	SHELL_CMD(holders, NULL, "Display threads holding a semaphore lock",
+		  ats_holders_cmd),
+#endif
+#ifdef CONFIG_LOCKING_STATS
+	SHELL_CMD(profile, NULL,
+		  "Print the usage profile of all locks for locking_advisor.py",
+		  ats_profile_cmd),
+#endif
+#ifdef CONFIG_LOCKING_BENCH
+	SHELL_CMD(bench, NULL,
+		  "Measure lock table lookups and display the table footprint",
+		  ats_bench_cmd),
+#endif
+#ifdef CONFIG_LOCKING_BLAME
+	SHELL_CMD(blame, NULL,
+		  "Display blocked time of threads on each lock\n"
+		  "[thread name or address]",
+		  ats_blame_cmd),
+#endif
+#ifdef CONFIG_LOCKING_INSTRUMENT
+	SHELL_CMD(instrument, NULL,
+		  "Get or set how much a lock is instrumented\n"
+		  "<id> [none|counters|timing|trace]",
+		  ats_instrument_cmd),
+#endif
+#ifdef CONFIG_LOCKING_PERSIST
+	SHELL_CMD(previous, NULL,
+		  "Display lock counters and events of the previous boot",
+		  ats_previous_cmd),
+#endif
 #ifdef CONFIG_LOCKING_SHELL_MANIPULATION
 	SHELL_CMD(give, NULL, "Give mutex/semaphore lock", ats_give_cmd),
 	SHELL_CMD(take, NULL, "Take mutex/semaphore lock", ats_take_cmd),
 	SHELL_CMD(reset, NULL, "Reset all locks", ats_reset_cmd),
+#endif
+#ifdef CONFIG_LOCKING_STRESS
+	SHELL_CMD(stress, NULL,
+		  "Take and give random locks from several threads and check "
+		  "for violations (test builds only)\n"
+		  "[threads] [seconds] [seed]",
+		  ats_stress_cmd),
 #endif
 	SHELL_SUBCMD_SET_END);
 
@@ -107,6 +186,139 @@ static int ats_get_cmd(const struct shell *shell, size_t argc, char **argv)
 	return r;
 }
 
+static int ats_memory_cmd(const struct shell *shell, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	return locking_show_memory(shell);
+}
+
+#ifdef CONFIG_LOCKING_HOLDERS
+static int ats_holders_cmd(const struct shell *shell, size_t argc, char **argv)
+{
+	int r = 0;
+	locking_id_t id = 0;
+
+	if ((argc == 2) && (argv[1] != NULL)) {
+		id = get_id(argv[1]);
+		r = locking_show_holders(shell, id);
+		if (r == -ENOTSUP) {
+			shell_error(shell, "Lock %d is not a semaphore", id);
+		} else if (r != 0) {
+			shell_error(shell, "Error getting lock holders: %d", r);
+		}
+	} else {
+		shell_error(shell, "Unexpected parameters");
+		r = -EINVAL;
+	}
+
+	return r;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+static int ats_profile_cmd(const struct shell *shell, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	return locking_show_profile(shell);
+}
+#endif
+
+#ifdef CONFIG_LOCKING_BENCH
+static int ats_bench_cmd(const struct shell *shell, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	return locking_show_bench(shell);
+}
+#endif
+
+#ifdef CONFIG_LOCKING_BLAME
+static int ats_blame_cmd(const struct shell *shell, size_t argc, char **argv)
+{
+	int r;
+
+	r = locking_show_blame(shell, (argc == 2) ? argv[1] : NULL);
+	if (r == -ENOENT) {
+		shell_error(shell, "Thread %s has not taken a lock", argv[1]);
+	}
+
+	return r;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_INSTRUMENT
+static int ats_instrument_cmd(const struct shell *shell, size_t argc,
+			      char **argv)
+{
+	enum locking_instrument level;
+	enum locking_instrument max;
+	locking_id_t id = 0;
+	int r;
+
+	if ((argc != 2 && argc != 3) || argv[1] == NULL) {
+		shell_error(shell, "Unexpected parameters");
+		return -EINVAL;
+	}
+
+	id = get_id(argv[1]);
+
+	if (argc == 3) {
+		for (level = 0; level < ARRAY_SIZE(INSTRUMENT_LEVELS); level++) {
+			if (strcmp(argv[2], INSTRUMENT_LEVELS[level]) == 0) {
+				break;
+			}
+		}
+		if (level == ARRAY_SIZE(INSTRUMENT_LEVELS)) {
+			shell_error(shell, "Unknown level %s", argv[2]);
+			return -EINVAL;
+		}
+
+		r = locking_set_instrument(id, level);
+		if (r == -ENOTSUP) {
+			shell_error(shell, "Lock %d (%s) was not compiled for %s",
+				    id, locking_get_name(id), argv[2]);
+			return r;
+		} else if (r != 0) {
+			shell_error(shell, "Error setting lock level: %d", r);
+			return r;
+		}
+	}
+
+	r = locking_get_instrument(id, &level, &max);
+	if (r != 0) {
+		shell_error(shell, "Error getting lock level: %d", r);
+		return r;
+	}
+
+	shell_print(shell, "Lock %d (%s) instrumented for %s (max %s)", id,
+		    locking_get_name(id), INSTRUMENT_LEVELS[level],
+		    INSTRUMENT_LEVELS[max]);
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_LOCKING_PERSIST
+static int ats_previous_cmd(const struct shell *shell, size_t argc,
+			    char **argv)
+{
+	int r;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	r = locking_show_previous(shell);
+	if (r == -ENODATA) {
+		shell_print(shell, "No data from the previous boot");
+		r = 0;
+	}
+
+	return r;
+}
+#endif
+
 #ifdef CONFIG_LOCKING_SHELL_MANIPULATION
 static int ats_give_cmd(const struct shell *shell, size_t argc, char **argv)
 {
@@ -174,6 +386,69 @@ static int ats_reset_cmd(const struct shell *shell, size_t argc, char **argv)
 }
 #endif
 
+#ifdef CONFIG_LOCKING_STRESS
+static int ats_stress_cmd(const struct shell *shell, size_t argc, char **argv)
+{
+	uint32_t threads = CONFIG_LOCKING_STRESS_THREADS;
+	uint32_t seconds = DEFAULT_STRESS_SECONDS;
+	uint32_t seed = k_cycle_get_32();
+	struct locking_stress_result result;
+	int r;
+
+	if (argc > 4) {
+		shell_error(shell, "Unexpected parameters");
+		return -EINVAL;
+	}
+
+	if (argc > 1) {
+		threads = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		seconds = strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+		seed = strtoul(argv[3], NULL, 0);
+	}
+
+	if (threads == 0 || threads > CONFIG_LOCKING_STRESS_THREADS) {
+		shell_error(shell, "Threads must be 1 to %d",
+			    CONFIG_LOCKING_STRESS_THREADS);
+		return -EINVAL;
+	} else if (seconds == 0 || seconds > MAX_STRESS_SECONDS) {
+		shell_error(shell, "Seconds must be 1 to %d",
+			    MAX_STRESS_SECONDS);
+		return -EINVAL;
+	}
+
+	/* xorshift never leaves 0 */
+	seed = (seed == 0) ? 1 : seed;
+
+	r = locking_stress(threads, seconds, seed, &result);
+	if (r == -EBUSY) {
+		shell_error(shell, "Stress test already running");
+		return r;
+	} else if (r != 0 && r != -EFAULT) {
+		shell_error(shell, "Stress test failed: %d", r);
+		return r;
+	}
+
+	shell_print(shell,
+		    "%u thread%s, %u ms, seed %u: %u ops (%u ops/s), "
+		    "%u lost wakeup%s, %u violation%s",
+		    threads, (threads == 1) ? "" : "s", result.elapsed_ms, seed,
+		    result.ops,
+		    (uint32_t)(((uint64_t)result.ops * 1000) /
+			       result.elapsed_ms),
+		    result.lost_wakeups, (result.lost_wakeups == 1) ? "" : "s",
+		    result.violations, (result.violations == 1) ? "" : "s");
+	if (r != 0) {
+		shell_error(shell, "Stress test failed: %d", r);
+	}
+
+	return r;
+}
+#endif
+
 static int locking_shell_init(const struct device *device)
 {
 	ARG_UNUSED(device);
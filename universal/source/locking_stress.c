@@ -0,0 +1,318 @@
+/**
+ * @file locking_stress.c
+ * @brief Multi-threaded stress test of every lock in the table
+ *
+ * Worker threads take and give randomly chosen locks, one at a time, while
+ * checking that a mutex (or ticket lock) never has two holders and that a
+ * semaphore never has more holders than units. Combining locks run the same
+ * check as a critical section through locking_execute(). A take that times
+ * out although every holder only keeps a lock for microseconds is reported
+ * as a lost wakeup. Semaphore units are counted before and after the run.
+ *
+ * The locks are really taken, so this is for test builds (e.g. a table made
+ * with locking_generator.py --synthesize) where the application is idle, such
+ * as tests/stress or the "locking stress" shell command.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <logging/log.h>
+LOG_MODULE_DECLARE(locking, CONFIG_LOCKING_LOG_LEVEL);
+
+#include <zephyr.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define THREADS CONFIG_LOCKING_STRESS_THREADS
+
+/* Maximum time a worker holds a lock (busy wait) */
+#define MAX_HOLD_US 50
+
+/* Violations logged in full, the rest are only counted */
+#define MAX_REPORTED 8
+
+/* Number of lock states captured per pass */
+#define STATE_CHUNK 8
+
+/* A critical section of a combining lock, run by whichever thread holds it */
+struct section {
+	const lte_t *entry;
+	locking_index_t index;
+	uint32_t hold_us;
+};
+
+struct worker {
+	struct k_thread thread;
+	uint32_t seed;
+	uint32_t ops;
+	uint32_t timeouts;
+};
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+K_THREAD_STACK_ARRAY_DEFINE(stacks, THREADS, CONFIG_LOCKING_STRESS_STACK_SIZE);
+static struct worker workers[THREADS];
+
+/* Threads inside each lock, checked against its capacity */
+static atomic_t inside[LOCKING_INDEX_COUNT];
+/* Free units of each lock before the run */
+static uint16_t initial[LOCKING_INDEX_COUNT];
+/* Locks that take no part (held before the run, or without free units) */
+static ATOMIC_DEFINE(skip, LOCKING_INDEX_COUNT);
+
+static atomic_t running;
+static atomic_t stop;
+static atomic_t violations;
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static void stress_thread(void *p1, void *p2, void *p3);
+static uint32_t next_random(uint32_t *state);
+static void violation(const lte_t *const entry, const char *what,
+		      uint32_t value);
+static void capture_initial(void);
+static void check_units(void);
+static uint16_t capacity(const lte_t *const entry, locking_index_t index);
+static void enter(const lte_t *const entry, locking_index_t index);
+#ifdef CONFIG_LOCKING_COMBINING
+static void run_section(void *arg);
+#endif
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+int locking_stress(uint8_t threads, uint32_t seconds, uint32_t seed,
+		   struct locking_stress_result *out)
+{
+	uint32_t ops = 0;
+	uint32_t timeouts = 0;
+	uint32_t start;
+	uint32_t elapsed;
+	uint8_t i;
+
+	if (threads == 0 || threads > THREADS || seconds == 0 || seed == 0 ||
+	    out == NULL) {
+		return -EINVAL;
+	} else if (!atomic_cas(&running, 0, 1)) {
+		return -EBUSY;
+	}
+
+	atomic_set(&stop, 0);
+	atomic_set(&violations, 0);
+	capture_initial();
+
+	start = k_uptime_get_32();
+	for (i = 0; i < threads; i++) {
+		workers[i].seed = seed + i + 1;
+		workers[i].ops = 0;
+		workers[i].timeouts = 0;
+		k_thread_create(&workers[i].thread, stacks[i],
+				K_THREAD_STACK_SIZEOF(stacks[i]), stress_thread,
+				&workers[i], NULL, NULL,
+				CONFIG_LOCKING_STRESS_PRIORITY, 0, K_NO_WAIT);
+		k_thread_name_set(&workers[i].thread, "locking_stress");
+	}
+
+	k_sleep(K_SECONDS(seconds));
+	atomic_set(&stop, 1);
+
+	/* Workers finish within one take timeout */
+	for (i = 0; i < threads; i++) {
+		k_thread_join(&workers[i].thread, K_FOREVER);
+		ops += workers[i].ops;
+		timeouts += workers[i].timeouts;
+	}
+	elapsed = MAX(k_uptime_get_32() - start, 1);
+
+	check_units();
+
+	out->ops = ops;
+	out->elapsed_ms = elapsed;
+	out->lost_wakeups = timeouts;
+	out->violations = (uint32_t)atomic_get(&violations);
+
+	atomic_set(&running, 0);
+
+	return (out->lost_wakeups == 0 && out->violations == 0) ? 0 : -EFAULT;
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static void stress_thread(void *p1, void *p2, void *p3)
+{
+	struct worker *w = p1;
+	const lte_t *entry;
+	locking_index_t index;
+	uint32_t r;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (!atomic_get(&stop)) {
+		r = next_random(&w->seed);
+		index = r % LOCKING_INDEX_COUNT;
+		if (atomic_test_bit(skip, index)) {
+			continue;
+		}
+		entry = locking_entry(index);
+
+#ifdef CONFIG_LOCKING_COMBINING
+		if (entry->type == LOCKING_TYPE_COMBINING) {
+			struct section section = { entry, index,
+						   (r >> 16) % MAX_HOLD_US };
+
+			/* Sections can't sleep, so they are never yielded */
+			if (locking_execute(entry->id, run_section,
+					    &section) != 0) {
+				violation(entry, "execute failed", 0);
+			}
+			w->ops++;
+			continue;
+		}
+#endif
+
+		if (locking_take(entry->id,
+				 K_MSEC(CONFIG_LOCKING_STRESS_TIMEOUT_MS)) != 0) {
+			w->timeouts++;
+			continue;
+		}
+
+		enter(entry, index);
+
+		if (r & BIT(31)) {
+			k_yield();
+		} else {
+			k_busy_wait((r >> 16) % MAX_HOLD_US);
+		}
+
+		atomic_dec(&inside[index]);
+		if (locking_give(entry->id) != 0) {
+			violation(entry, "give failed", 0);
+		}
+		w->ops++;
+	}
+}
+
+/* xorshift32, a worker's sequence only depends on the seed */
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+static void violation(const lte_t *const entry, const char *what,
+		      uint32_t value)
+{
+	if (atomic_inc(&violations) < MAX_REPORTED) {
+		LOG_ERR("Stress %u %s: %s %u", entry->id, entry->name, what,
+			value);
+	}
+}
+
+/* Locks that are held, or semaphores without free units, are left out */
+static void capture_initial(void)
+{
+	struct locking_state states[STATE_CHUNK];
+	locking_index_t i = 0;
+	int count;
+	int j;
+
+	while (i < LOCKING_INDEX_COUNT) {
+		count = locking_snapshot_range(i, states, ARRAY_SIZE(states));
+		for (j = 0; j < count; j++) {
+			switch (states[j].type) {
+			case LOCKING_TYPE_SEMAPHORE:
+				initial[i + j] = (states[j].free > UINT16_MAX) ?
+							 0 :
+							 states[j].free;
+				break;
+			case LOCKING_TYPE_MUTEX:
+			case LOCKING_TYPE_TICKET:
+			case LOCKING_TYPE_COMBINING:
+				initial[i + j] = (states[j].lock_count != 0) ?
+							 0 :
+							 1;
+				break;
+			default:
+				initial[i + j] = 0;
+				break;
+			}
+			atomic_set_bit_to(skip, i + j, initial[i + j] == 0);
+			atomic_set(&inside[i + j], 0);
+		}
+		i += count;
+	}
+}
+
+/* Every unit taken must have been given back */
+static void check_units(void)
+{
+	struct locking_state states[STATE_CHUNK];
+	locking_index_t i = 0;
+	int count;
+	int j;
+
+	while (i < LOCKING_INDEX_COUNT) {
+		count = locking_snapshot_range(i, states, ARRAY_SIZE(states));
+		for (j = 0; j < count; j++) {
+			if (atomic_test_bit(skip, i + j)) {
+				continue;
+			}
+
+			if (states[j].type == LOCKING_TYPE_SEMAPHORE &&
+			    states[j].free != initial[i + j]) {
+				violation(locking_entry(i + j), "units",
+					  states[j].free);
+			} else if (states[j].type != LOCKING_TYPE_SEMAPHORE &&
+				   states[j].lock_count != 0) {
+				violation(locking_entry(i + j), "still held",
+					  states[j].lock_count);
+			}
+		}
+		i += count;
+	}
+}
+
+static uint16_t capacity(const lte_t *const entry, locking_index_t index)
+{
+	return (entry->type == LOCKING_TYPE_SEMAPHORE) ? initial[index] : 1;
+}
+
+static void enter(const lte_t *const entry, locking_index_t index)
+{
+	atomic_val_t holders = atomic_inc(&inside[index]) + 1;
+
+	if (holders > capacity(entry, index)) {
+		violation(entry, "holders", holders);
+	}
+}
+
+#ifdef CONFIG_LOCKING_COMBINING
+static void run_section(void *arg)
+{
+	struct section *section = arg;
+
+	enter(section->entry, section->index);
+	k_busy_wait(section->hold_us);
+	atomic_dec(&inside[section->index]);
+}
+#endif
@@ -0,0 +1,236 @@
+/**
+ * @file locking_ticket.c
+ * @brief FIFO (ticket) lock
+ *
+ * Waiters queue a node on their own stack and sleep on a semaphore in it.
+ * A give hands the lock straight to the head of the queue, so a thread that
+ * keeps re-acquiring cannot overtake threads that are already waiting the way
+ * it can with k_mutex (which wakes the highest priority waiter and lets
+ * whoever runs first take it).
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include "locking_ticket.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+struct waiter {
+	sys_dnode_t node;
+	struct k_sem sem;
+	struct k_thread *thread;
+	int priority;
+	/* Times this waiter has been overtaken */
+	uint8_t bypassed;
+};
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static void enqueue(struct locking_ticket *ticket, struct waiter *w);
+static uint64_t elapsed(uint32_t start, int64_t start_ticks);
+static void update_metrics(struct locking_ticket *ticket, uint64_t waited,
+			   uint8_t bypassed);
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_ticket_init(struct locking_ticket *ticket, uint8_t bypass)
+{
+	sys_dlist_init(&ticket->queue);
+	ticket->owner = NULL;
+	ticket->bypass = bypass;
+	memset(&ticket->metrics, 0, sizeof(ticket->metrics));
+}
+
+int locking_ticket_take(struct locking_ticket *ticket, k_timeout_t wait_time)
+{
+	struct waiter w;
+	k_spinlock_key_t key;
+	uint32_t start;
+	int64_t start_ticks;
+	int r;
+
+	key = k_spin_lock(&ticket->lock);
+	if (ticket->owner == NULL) {
+		/* The lock is handed over on give, so it is only free when
+		 * nobody is queued.
+		 */
+		ticket->owner = k_current_get();
+		k_spin_unlock(&ticket->lock, key);
+		return 0;
+	} else if (ticket->owner == k_current_get()) {
+		k_spin_unlock(&ticket->lock, key);
+		return -EDEADLK;
+	} else if (K_TIMEOUT_EQ(wait_time, K_NO_WAIT)) {
+		k_spin_unlock(&ticket->lock, key);
+		return -EBUSY;
+	}
+
+	k_sem_init(&w.sem, 0, 1);
+	w.thread = k_current_get();
+	w.priority = k_thread_priority_get(w.thread);
+	w.bypassed = 0;
+	enqueue(ticket, &w);
+	start = k_cycle_get_32();
+	start_ticks = k_uptime_ticks();
+	k_spin_unlock(&ticket->lock, key);
+
+	r = k_sem_take(&w.sem, wait_time);
+
+	key = k_spin_lock(&ticket->lock);
+	if (r != 0) {
+		if (sys_dnode_is_linked(&w.node)) {
+			sys_dlist_remove(&w.node);
+			k_spin_unlock(&ticket->lock, key);
+			return -EAGAIN;
+		}
+		/* Granted after the timeout expired, the giver has already
+		 * made this thread the owner and is about to give the
+		 * semaphore, which must happen before w goes out of scope.
+		 */
+		k_spin_unlock(&ticket->lock, key);
+		(void)k_sem_take(&w.sem, K_FOREVER);
+		key = k_spin_lock(&ticket->lock);
+	}
+	update_metrics(ticket, elapsed(start, start_ticks), w.bypassed);
+	k_spin_unlock(&ticket->lock, key);
+
+	return 0;
+}
+
+int locking_ticket_give(struct locking_ticket *ticket)
+{
+	struct waiter *next = NULL;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&ticket->lock);
+	if (ticket->owner != k_current_get()) {
+		k_spin_unlock(&ticket->lock, key);
+		return -EPERM;
+	}
+
+	next = SYS_DLIST_CONTAINER(sys_dlist_get(&ticket->queue), next, node);
+	ticket->owner = (next == NULL) ? NULL : next->thread;
+	k_spin_unlock(&ticket->lock, key);
+
+	/* Outside the spinlock so that the waiter can be scheduled at once */
+	if (next != NULL) {
+		k_sem_give(&next->sem);
+	}
+
+	return 0;
+}
+
+int locking_ticket_handoff(struct locking_ticket *ticket, struct k_thread *to)
+{
+	struct waiter *w;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&ticket->lock);
+	if (ticket->owner != k_current_get()) {
+		k_spin_unlock(&ticket->lock, key);
+		return -EPERM;
+	}
+
+	/* A queued thread would be granted the lock it already owns */
+	SYS_DLIST_FOR_EACH_CONTAINER (&ticket->queue, w, node) {
+		if (w->thread == to) {
+			k_spin_unlock(&ticket->lock, key);
+			return -EBUSY;
+		}
+	}
+
+	ticket->owner = to;
+	k_spin_unlock(&ticket->lock, key);
+
+	return 0;
+}
+
+void locking_ticket_metrics_get(struct locking_ticket *ticket,
+				struct locking_ticket_metrics *metrics)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&ticket->lock);
+	*metrics = ticket->metrics;
+	k_spin_unlock(&ticket->lock, key);
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* Must be called with the ticket spinlock held */
+static void enqueue(struct locking_ticket *ticket, struct waiter *w)
+{
+	sys_dnode_t *node = sys_dlist_peek_tail(&ticket->queue);
+	sys_dnode_t *before = NULL;
+	struct waiter *other;
+
+	/* Walk back from the tail past lower priority waiters that can still
+	 * be overtaken, with no bypass allowance this is a plain append.
+	 */
+	while (node != NULL && ticket->bypass != 0) {
+		other = CONTAINER_OF(node, struct waiter, node);
+		if (w->priority >= other->priority ||
+		    other->bypassed >= ticket->bypass) {
+			break;
+		}
+		before = node;
+		node = sys_dlist_peek_prev(&ticket->queue, node);
+	}
+
+	if (before == NULL) {
+		sys_dlist_append(&ticket->queue, &w->node);
+		return;
+	}
+
+	sys_dlist_insert(before, &w->node);
+
+	/* Charge everyone that was overtaken */
+	for (node = before; node != NULL;
+	     node = sys_dlist_peek_next(&ticket->queue, node)) {
+		other = CONTAINER_OF(node, struct waiter, node);
+		other->bypassed++;
+	}
+}
+
+/* The 32-bit cycle counter wraps after a few seconds on fast clocks, waits
+ * longer than half of its range are measured in ticks instead.
+ */
+static uint64_t elapsed(uint32_t start, int64_t start_ticks)
+{
+	uint64_t cycles =
+		k_ticks_to_cyc_floor64((uint64_t)(k_uptime_ticks() - start_ticks));
+
+	if (cycles >= (UINT32_MAX / 2)) {
+		return cycles;
+	}
+
+	return k_cycle_get_32() - start;
+}
+
+/* Must be called with the ticket spinlock held */
+static void update_metrics(struct locking_ticket *ticket, uint64_t waited,
+			   uint8_t bypassed)
+{
+	struct locking_ticket_metrics *m = &ticket->metrics;
+
+	if (m->waits == 0 || waited < m->min_wait) {
+		m->min_wait = waited;
+	}
+	m->max_wait = MAX(m->max_wait, waited);
+	m->total_wait += waited;
+	m->waits++;
+	m->max_bypass = MAX(m->max_bypass, bypassed);
+}
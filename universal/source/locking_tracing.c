@@ -0,0 +1,77 @@
+/**
+ * @file locking_tracing.c
+ * @brief Lock operations as CTF events
+ *
+ * Zephyr traces the k_mutex/k_sem underneath, but not which lock of the table
+ * it is. These events carry the lock ID (mapped to its name by the generated
+ * tsdl/locking_metadata), table index and thread so that per-lock contention
+ * can be viewed next to the scheduler events, or analysed on its own with
+ * locking_trace_analyzer.py.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <ctf_top.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+#include "locking_tracing.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+BUILD_ASSERT(LOCKING_TABLE_CTF_EVENT_ID == CONFIG_LOCKING_TRACING_EVENT_ID,
+	     "Regenerate the lock table with --ctf-event-id to match "
+	     "CONFIG_LOCKING_TRACING_EVENT_ID");
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_trace_take_enter(const lte_t *const entry)
+{
+	locking_id_t id = entry->id;
+	locking_index_t index = locking_table_index(entry);
+	uint32_t thread = (uint32_t)(uintptr_t)k_current_get();
+
+	CTF_EVENT(CTF_LITERAL(uint8_t, LOCKING_CTF_TAKE_ENTER), id, index,
+		  thread);
+}
+
+void locking_trace_take_exit(const lte_t *const entry, int r)
+{
+	locking_id_t id = entry->id;
+	locking_index_t index = locking_table_index(entry);
+	uint32_t thread = (uint32_t)(uintptr_t)k_current_get();
+	int32_t result = r;
+
+	CTF_EVENT(CTF_LITERAL(uint8_t, LOCKING_CTF_TAKE_EXIT), id, index,
+		  thread, result);
+}
+
+void locking_trace_give(const lte_t *const entry, int r)
+{
+	locking_id_t id = entry->id;
+	locking_index_t index = locking_table_index(entry);
+	uint32_t thread = (uint32_t)(uintptr_t)k_current_get();
+	int32_t result = r;
+
+	CTF_EVENT(CTF_LITERAL(uint8_t, LOCKING_CTF_GIVE), id, index, thread,
+		  result);
+}
+
+void locking_trace_handoff(const lte_t *const entry, struct k_thread *to)
+{
+	locking_id_t id = entry->id;
+	locking_index_t index = locking_table_index(entry);
+	uint32_t thread = (uint32_t)(uintptr_t)k_current_get();
+	uint32_t new_owner = (uint32_t)(uintptr_t)to;
+
+	CTF_EVENT(CTF_LITERAL(uint8_t, LOCKING_CTF_HANDOFF), id, index, thread,
+		  new_owner);
+}
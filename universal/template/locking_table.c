@@ -0,0 +1,143 @@
+/**
+ * @file locking_table.c
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <string.h>
+
+#include "locking_table.h"
+#include "locking_table_private.h"
+
+/* clang-format off */
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+/* pystart - locks */
+/* pyend */
+
+/******************************************************************************/
+/* Global Data Definitions                                                    */
+/******************************************************************************/
+
+/**
+ * @brief Table shorthand
+ *
+ * @ref CreateStruct (Python script)
+ *
+ *.........name...value...
+ */
+#ifdef CONFIG_LOCKING_STRING_NAME
+#define LOCK_NAME(n) .name = STRINGIFY(n)
+#else
+#define LOCK_NAME(n) .name = ""
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+#define LOCK(n) LOCK_NAME(n), .pData = &n.lock, .stats = &n.stats
+#else
+#define LOCK(n) LOCK_NAME(n), .pData = &n.lock
+#endif
+
+#ifdef CONFIG_LOCKING_HOLDERS
+#define SEM_LOCK(n) LOCK(n), .holders = &n##_holders
+#else
+#define SEM_LOCK(n) LOCK(n)
+#endif
+
+/* x-instances, an array of lock objects under one ID */
+#ifdef CONFIG_LOCKING_STRIPED
+#define STRIPES(n) , .stripes = ARRAY_SIZE(n), .stride = sizeof(n[0])
+#else
+#define STRIPES(n)
+#endif
+
+#ifdef CONFIG_LOCKING_STATS
+#define STRIPED_LOCK(n) LOCK_NAME(n), .pData = &n[0].lock, .stats = &n[0].stats STRIPES(n)
+#else
+#define STRIPED_LOCK(n) LOCK_NAME(n), .pData = &n[0].lock STRIPES(n)
+#endif
+
+/* index....id.name.....................type...count.limit. */
+const struct locking_table_entry LOCKING_TABLE[LOCKING_TABLE_SIZE] = {
+	/* pystart - locking table */
+	/* pyend */
+};
+
+/**
+ * @brief map id to table entry (invalid entries are NULL)
+ */
+static const struct locking_table_entry * const LOCKING_MAP[] = {
+	/* pystart - locking map */
+	/* pyend */
+};
+BUILD_ASSERT(ARRAY_SIZE(LOCKING_MAP) == (LOCKING_TABLE_MAX_ID + 1),
+	     "Invalid locking map");
+
+/**
+ * @brief RAM used by the lock objects (aligned slots include their padding)
+ *        and flash used by the table, map and names
+ */
+const struct locking_footprint LOCKING_FOOTPRINT = {
+	/* pystart - footprint */
+	/* pyend */
+};
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void locking_table_initialise(void)
+{
+	/* pystart - init */
+	/* pyend */
+}
+
+void locking_table_reset(void)
+{
+	/* pystart - reset */
+	/* pyend */
+}
+
+const struct locking_table_entry *const locking_map(locking_id_t id)
+{
+	if (id > LOCKING_TABLE_MAX_ID) {
+#ifdef CONFIG_LOCKING_DYNAMIC
+		return locking_dynamic_map(id);
+#else
+		return NULL;
+#endif
+	} else {
+		return LOCKING_MAP[id];
+	}
+}
+
+locking_index_t locking_table_index(const struct locking_table_entry *const entry)
+{
+#ifdef CONFIG_LOCKING_DYNAMIC
+	if (!PART_OF_ARRAY(LOCKING_TABLE, entry)) {
+		return locking_dynamic_index(entry);
+	}
+#endif
+	__ASSERT(PART_OF_ARRAY(LOCKING_TABLE, entry), "Invalid entry");
+	return (entry - &LOCKING_TABLE[0]);
+}
+
+const struct locking_table_entry *locking_entry(locking_index_t index)
+{
+	if (index < LOCKING_TABLE_SIZE) {
+		return &LOCKING_TABLE[index];
+	}
+#ifdef CONFIG_LOCKING_DYNAMIC
+	return locking_dynamic_entry(index - LOCKING_TABLE_SIZE);
+#else
+	return NULL;
+#endif
+}